@@ -0,0 +1,339 @@
+/*
+ * Замеры всех этапов обработки на синтетических городах разного размера.
+ * Собирается целью benchmark из CMakeLists.txt в корне репозитория: все исходники transport-catalogue,
+ * кроме main.cpp, input_reader.cpp и stat_reader.cpp.
+ *
+ *   benchmark [--stops=100,1000,10000,100000] [--buses=M] [--route-length=MIN,MAX] [--roundtrip-share=P]
+ *             [--extra-distances=K] [--requests=N] [--mix=BUS,STOP,ROUTE,MAP] [--seed=S]
+ *             [--max-router-stops=N] [--output=FILE]
+ *   benchmark --generate [те же параметры города]   выводит входной JSON для первого размера из --stops
+ *
+ * Результаты выводятся в JSON (в stdout или в FILE), по одному элементу "runs" на каждый размер
+ */
+
+#include "city_generator.h"
+
+#include "json.h"
+#include "json_reader.h"
+#include "request_handler.h"
+#include "transport_router.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+    struct BenchmarkOptions {
+        std::vector<size_t> stop_counts{ 100, 1000, 10000, 100000 };
+        // Без значения число маршрутов — десятая часть числа остановок
+        std::optional<size_t> bus_count;
+        benchmark::CityParams city;
+        // Floyd-Warshall хранит матрицу V x V, поэтому на крупных городах маршрутизатор не строится
+        // и запросы Route пропускаются
+        size_t max_router_stops = 2000;
+        bool generate = false;
+        std::string output_path;
+    };
+
+    bool StartsWith(std::string_view arg, std::string_view prefix) {
+        return arg.substr(0, prefix.size()) == prefix;
+    }
+
+    std::vector<double> ParseNumbers(std::string_view list) {
+        std::vector<double> numbers;
+        while (!list.empty()) {
+            const size_t comma = list.find(',');
+            const std::string item(list.substr(0, comma));
+            char* end = nullptr;
+            numbers.push_back(std::strtod(item.c_str(), &end));
+            if (item.empty() || *end != '\0') {
+                throw std::invalid_argument("Not a number: "s + item);
+            }
+            list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+        }
+        return numbers;
+    }
+
+    double ParseNumber(std::string_view value) {
+        const std::vector<double> numbers = ParseNumbers(value);
+        if (numbers.size() != 1) {
+            throw std::invalid_argument("Expected a single number: "s + std::string(value));
+        }
+        return numbers.front();
+    }
+
+    BenchmarkOptions ParseOptions(int argc, char* argv[]) {
+        BenchmarkOptions options;
+        options.city.stat_request_count = 1000;
+        options.city.min_route_length = 10;
+        options.city.max_route_length = 30;
+        // Каждый ответ Map содержит карту целиком, поэтому на крупных городах они занимают почти весь вывод
+        options.city.stat_mix = { 0.3, 0.3, 0.395, 0.005 };
+
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view arg = argv[i];
+            const size_t equals = arg.find('=');
+            const std::string_view value = equals == std::string_view::npos ? std::string_view{} : arg.substr(equals + 1);
+
+            if (arg == "--generate"sv) {
+                options.generate = true;
+            }
+            else if (StartsWith(arg, "--stops="sv)) {
+                options.stop_counts.clear();
+                for (double count : ParseNumbers(value)) {
+                    options.stop_counts.push_back(static_cast<size_t>(count));
+                }
+            }
+            else if (StartsWith(arg, "--buses="sv)) {
+                options.bus_count = static_cast<size_t>(ParseNumber(value));
+            }
+            else if (StartsWith(arg, "--route-length="sv)) {
+                const std::vector<double> lengths = ParseNumbers(value);
+                if (lengths.size() != 2) {
+                    throw std::invalid_argument("--route-length expects MIN,MAX"s);
+                }
+                options.city.min_route_length = static_cast<size_t>(lengths[0]);
+                options.city.max_route_length = static_cast<size_t>(lengths[1]);
+            }
+            else if (StartsWith(arg, "--roundtrip-share="sv)) {
+                options.city.roundtrip_share = ParseNumber(value);
+            }
+            else if (StartsWith(arg, "--extra-distances="sv)) {
+                options.city.extra_distances_per_stop = static_cast<size_t>(ParseNumber(value));
+            }
+            else if (StartsWith(arg, "--requests="sv)) {
+                options.city.stat_request_count = static_cast<size_t>(ParseNumber(value));
+            }
+            else if (StartsWith(arg, "--mix="sv)) {
+                const std::vector<double> mix = ParseNumbers(value);
+                if (mix.size() != 4) {
+                    throw std::invalid_argument("--mix expects BUS,STOP,ROUTE,MAP"s);
+                }
+                options.city.stat_mix = { mix[0], mix[1], mix[2], mix[3] };
+            }
+            else if (StartsWith(arg, "--seed="sv)) {
+                options.city.seed = static_cast<uint64_t>(ParseNumber(value));
+            }
+            else if (StartsWith(arg, "--max-router-stops="sv)) {
+                options.max_router_stops = static_cast<size_t>(ParseNumber(value));
+            }
+            else if (StartsWith(arg, "--output="sv)) {
+                options.output_path = value;
+            }
+            else {
+                throw std::invalid_argument("Unknown option: "s + std::string(arg));
+            }
+        }
+
+        if (options.stop_counts.empty()) {
+            throw std::invalid_argument("--stops must list at least one city size"s);
+        }
+        return options;
+    }
+
+    benchmark::CityParams GetCityParams(const BenchmarkOptions& options, size_t stop_count) {
+        benchmark::CityParams params = options.city;
+        params.stop_count = stop_count;
+        params.bus_count = options.bus_count.value_or(std::max<size_t>(1, stop_count / 10));
+        return params;
+    }
+
+    class Stopwatch {
+    public:
+        Stopwatch()
+            : start_(std::chrono::steady_clock::now()) {
+        }
+
+        double ElapsedMilliseconds() const {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+        }
+
+    private:
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    // Большие значения не помещаются в int узла JSON и выводятся как double
+    json::Node ToNode(size_t value) {
+        if (value <= static_cast<size_t>(std::numeric_limits<int>::max())) {
+            return static_cast<int>(value);
+        }
+        return static_cast<double>(value);
+    }
+
+    // Сводка по задержкам запросов одного типа
+    json::Dict SummarizeLatencies(std::vector<double> latencies_ms) {
+        std::sort(latencies_ms.begin(), latencies_ms.end());
+        auto percentile = [&latencies_ms](double share) {
+            const size_t index = static_cast<size_t>(share * static_cast<double>(latencies_ms.size() - 1));
+            return latencies_ms[index] * 1e3;
+        };
+
+        double total_ms = 0.0;
+        for (double latency : latencies_ms) {
+            total_ms += latency;
+        }
+
+        json::Dict summary;
+        summary["count"s] = ToNode(latencies_ms.size());
+        summary["total_ms"s] = total_ms;
+        summary["mean_us"s] = total_ms * 1e3 / static_cast<double>(latencies_ms.size());
+        summary["p50_us"s] = percentile(0.5);
+        summary["p99_us"s] = percentile(0.99);
+        summary["max_us"s] = latencies_ms.back() * 1e3;
+        return summary;
+    }
+
+    json::Dict RunBenchmark(const benchmark::CityParams& params, size_t max_router_stops) {
+        std::cerr << "benchmark: "s << params.stop_count << " stops, "s << params.bus_count << " buses"s << std::endl;
+
+        json::Dict phases;
+        json::Array skipped;
+
+        const json::Document city = benchmark::GenerateCity(params);
+        std::string input;
+        {
+            std::ostringstream out;
+            json::Print(city, out);
+            input = out.str();
+        }
+
+        std::istringstream input_stream(input);
+        Stopwatch load_watch;
+        const json_reader::JsonReader reader(input_stream);
+        phases["json_load_ms"s] = load_watch.ElapsedMilliseconds();
+
+        Stopwatch ingest_watch;
+        const transport_catalogue::TransportCatalogue tc = reader.ApplyBaseRequests();
+        phases["ingest_ms"s] = ingest_watch.ElapsedMilliseconds();
+
+        const map_renderer::RenderSettings render_settings = reader.ApplyRenderSettings();
+        const graph::RouteSetting route_setting = reader.ApplyRoutingSetting();
+
+        // Граф и предрасчёт замеряются отдельно; для ответов на запросы маршрутизатор строится ещё раз
+        const bool with_router = params.stop_count <= max_router_stops;
+        size_t vertex_count = 0;
+        size_t edge_count = 0;
+        if (with_router) {
+            Stopwatch graph_watch;
+            const graph::TransportGraph<double> transport_graph(tc, route_setting);
+            phases["build_graph_ms"s] = graph_watch.ElapsedMilliseconds();
+            vertex_count = transport_graph.GetGraph().GetVertexCount();
+            edge_count = transport_graph.GetGraph().GetEdgeCount();
+
+            Stopwatch router_watch;
+            const graph::Router<double> router(transport_graph.GetGraph());
+            phases["router_precompute_ms"s] = router_watch.ElapsedMilliseconds();
+        }
+        else {
+            skipped.push_back("build_graph"s);
+            skipped.push_back("router_precompute"s);
+            skipped.push_back("Route"s);
+        }
+        graph::LazyTransportRouter<double> tr(tc, route_setting,
+            with_router ? graph::RouterBuildMode::EAGER : graph::RouterBuildMode::LAZY);
+
+        const RequestHandler rh(tc, render_settings);
+        size_t map_bytes = 0;
+        {
+            std::ostringstream out;
+            Stopwatch render_watch;
+            rh.RenderMap(out);
+            phases["render_map_ms"s] = render_watch.ElapsedMilliseconds();
+            map_bytes = out.str().size();
+        }
+
+        std::map<std::string, std::vector<double>> latencies;
+        json::Array answers;
+        Stopwatch queries_watch;
+        for (const json::Node& request : city.GetRoot().AsDict().at("stat_requests"s).AsArray()) {
+            const std::string& type = request.AsDict().at("type"s).AsString();
+            if (!with_router && type == "Route"s) {
+                continue;
+            }
+            Stopwatch request_watch;
+            answers.push_back(reader.AnswerStatRequest(request.AsDict(), tc, rh, tr));
+            latencies[type].push_back(request_watch.ElapsedMilliseconds());
+        }
+        phases["stat_requests_ms"s] = queries_watch.ElapsedMilliseconds();
+
+        size_t output_bytes = 0;
+        {
+            std::ostringstream out;
+            Stopwatch print_watch;
+            json::Print(json::Document(std::move(answers)), out);
+            phases["json_print_ms"s] = print_watch.ElapsedMilliseconds();
+            output_bytes = out.str().size();
+        }
+
+        json::Dict queries;
+        for (auto& [type, type_latencies] : latencies) {
+            queries[type] = SummarizeLatencies(std::move(type_latencies));
+        }
+
+        json::Dict run;
+        run["stops"s] = ToNode(params.stop_count);
+        run["buses"s] = ToNode(params.bus_count);
+        run["stat_requests"s] = ToNode(params.stat_request_count);
+        run["seed"s] = ToNode(static_cast<size_t>(params.seed));
+        run["input_bytes"s] = ToNode(input.size());
+        run["map_bytes"s] = ToNode(map_bytes);
+        run["output_bytes"s] = ToNode(output_bytes);
+        run["graph_vertices"s] = ToNode(vertex_count);
+        run["graph_edges"s] = ToNode(edge_count);
+        run["phases"s] = std::move(phases);
+        run["queries"s] = std::move(queries);
+        run["skipped"s] = std::move(skipped);
+        return run;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        const BenchmarkOptions options = ParseOptions(argc, argv);
+
+        if (options.generate) {
+            json::Print(benchmark::GenerateCity(GetCityParams(options, options.stop_counts.front())), std::cout);
+            std::cout << '\n';
+            return 0;
+        }
+
+        json::Array runs;
+        for (size_t stop_count : options.stop_counts) {
+            runs.push_back(RunBenchmark(GetCityParams(options, stop_count), options.max_router_stops));
+        }
+
+        json::Dict results;
+        results["benchmark"s] = "transport-catalogue"s;
+        results["runs"s] = std::move(runs);
+        const json::Document document(std::move(results));
+
+        if (options.output_path.empty()) {
+            json::Print(document, std::cout);
+            std::cout << '\n';
+        }
+        else {
+            std::ofstream out(options.output_path);
+            if (!out) {
+                throw std::runtime_error("Failed to open output file "s + options.output_path);
+            }
+            json::Print(document, out);
+            out << '\n';
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "benchmark: "s << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,254 @@
+#include "city_generator.h"
+#include "geo.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace benchmark {
+
+    using namespace std::literals;
+
+    namespace {
+        // Распределения стандартной библиотеки зависят от реализации, поэтому числа из генератора
+        // (его последовательность задана стандартом) преобразуются вручную
+        class Random {
+        public:
+            explicit Random(uint64_t seed)
+                : engine_(seed) {
+            }
+
+            // Случайное число из [0, count)
+            size_t Index(size_t count) {
+                return static_cast<size_t>(engine_() % count);
+            }
+
+            // Случайное число из [0, 1)
+            double Uniform() {
+                return static_cast<double>(engine_() >> 11) * 0x1.0p-53;
+            }
+
+            double Uniform(double min, double max) {
+                return min + (max - min) * Uniform();
+            }
+
+        private:
+            std::mt19937_64 engine_;
+        };
+
+        // Остановки стоят в узлах сетки columns x rows, номер остановки — row * columns + column
+        class Grid {
+        public:
+            explicit Grid(size_t stop_count)
+                : stop_count_(stop_count)
+                , columns_(std::max<size_t>(1, static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(stop_count)))))) {
+            }
+
+            size_t GetColumns() const {
+                return columns_;
+            }
+
+            // Соседние по сетке остановки
+            std::vector<size_t> GetNeighbours(size_t stop) const {
+                std::vector<size_t> neighbours;
+                const size_t row = stop / columns_;
+                const size_t column = stop % columns_;
+                if (column > 0) {
+                    neighbours.push_back(stop - 1);
+                }
+                if (column + 1 < columns_ && stop + 1 < stop_count_) {
+                    neighbours.push_back(stop + 1);
+                }
+                if (row > 0) {
+                    neighbours.push_back(stop - columns_);
+                }
+                if (stop + columns_ < stop_count_) {
+                    neighbours.push_back(stop + columns_);
+                }
+                return neighbours;
+            }
+
+        private:
+            size_t stop_count_;
+            size_t columns_;
+        };
+
+        std::string StopName(size_t stop) {
+            return "Stop "s + std::to_string(stop);
+        }
+
+        std::string BusName(size_t bus) {
+            return "Bus "s + std::to_string(bus);
+        }
+
+        json::Dict MakeRenderSettings() {
+            json::Dict settings;
+            settings["width"s] = 1200.0;
+            settings["height"s] = 1200.0;
+            settings["padding"s] = 50.0;
+            settings["line_width"s] = 14.0;
+            settings["stop_radius"s] = 5.0;
+            settings["bus_label_font_size"s] = 20;
+            settings["bus_label_offset"s] = json::Array{ 7.0, 15.0 };
+            settings["stop_label_font_size"s] = 20;
+            settings["stop_label_offset"s] = json::Array{ 7.0, -3.0 };
+            settings["underlayer_color"s] = json::Array{ 255, 255, 255, 0.85 };
+            settings["underlayer_width"s] = 3.0;
+            settings["color_palette"s] = json::Array{ "green"s, json::Array{ 255, 160, 0 }, "red"s };
+            return settings;
+        }
+
+        json::Dict MakeRoutingSettings() {
+            json::Dict settings;
+            settings["bus_wait_time"s] = 6;
+            settings["bus_velocity"s] = 40;
+            return settings;
+        }
+    }
+
+    json::Document GenerateCity(const CityParams& params) {
+        if (params.stop_count < 2) {
+            throw std::invalid_argument("A city needs at least 2 stops"s);
+        }
+        if (params.min_route_length < 2 || params.min_route_length > params.max_route_length) {
+            throw std::invalid_argument("Route lengths must satisfy 2 <= min_route_length <= max_route_length"s);
+        }
+
+        Random random(params.seed);
+        const Grid grid(params.stop_count);
+
+        // Город занимает примерно 0.4 x 0.4 градуса, узлы сетки сдвинуты на случайную долю шага
+        const double step = 0.4 / static_cast<double>(grid.GetColumns());
+        std::vector<geo::Coordinates> coordinates(params.stop_count);
+        for (size_t stop = 0; stop < params.stop_count; ++stop) {
+            coordinates[stop] = {
+                55.5 + static_cast<double>(stop / grid.GetColumns()) * step + random.Uniform(-0.3, 0.3) * step,
+                37.3 + static_cast<double>(stop % grid.GetColumns()) * step + random.Uniform(-0.3, 0.3) * step,
+            };
+        }
+
+        // Дорожное расстояние длиннее расстояния по прямой на 10–50%; у пары хранится одно направление
+        std::vector<std::map<size_t, int>> distances(params.stop_count);
+        auto add_distance = [&](size_t from, size_t to) {
+            if (from == to || distances[from].count(to) || distances[to].count(from)) {
+                return;
+            }
+            const double direct = geo::ComputeDistance(coordinates[from], coordinates[to]);
+            distances[from][to] = std::max(1, static_cast<int>(std::lround(direct * random.Uniform(1.1, 1.5))));
+        };
+
+        // Маршрут — случайное блуждание по соседям без немедленного возврата, если есть другой путь
+        std::vector<std::vector<size_t>> routes(params.bus_count);
+        std::vector<bool> roundtrips(params.bus_count);
+        std::vector<size_t> route_stops;
+        for (size_t bus = 0; bus < params.bus_count; ++bus) {
+            const size_t length = params.min_route_length + random.Index(params.max_route_length - params.min_route_length + 1);
+            roundtrips[bus] = random.Uniform() < params.roundtrip_share;
+
+            std::vector<size_t>& route = routes[bus];
+            route.push_back(random.Index(params.stop_count));
+            const size_t walk_length = roundtrips[bus] ? std::max<size_t>(2, length - 1) : length;
+            while (route.size() < walk_length) {
+                std::vector<size_t> neighbours = grid.GetNeighbours(route.back());
+                if (route.size() > 1 && neighbours.size() > 1) {
+                    neighbours.erase(std::remove(neighbours.begin(), neighbours.end(), route[route.size() - 2]), neighbours.end());
+                }
+                route.push_back(neighbours[random.Index(neighbours.size())]);
+            }
+            if (roundtrips[bus]) {
+                route.push_back(route.front());
+            }
+
+            for (size_t i = 1; i < route.size(); ++i) {
+                add_distance(route[i - 1], route[i]);
+            }
+            route_stops.insert(route_stops.end(), route.begin(), route.end());
+        }
+
+        for (size_t stop = 0; stop < params.stop_count; ++stop) {
+            const std::vector<size_t> neighbours = grid.GetNeighbours(stop);
+            for (size_t i = 0; i < params.extra_distances_per_stop && !neighbours.empty(); ++i) {
+                add_distance(stop, neighbours[random.Index(neighbours.size())]);
+            }
+        }
+
+        json::Array base_requests;
+        base_requests.reserve(params.stop_count + params.bus_count);
+        for (size_t stop = 0; stop < params.stop_count; ++stop) {
+            json::Dict road_distances;
+            for (const auto& [to, distance] : distances[stop]) {
+                road_distances[StopName(to)] = distance;
+            }
+
+            json::Dict request;
+            request["type"s] = "Stop"s;
+            request["name"s] = StopName(stop);
+            request["latitude"s] = coordinates[stop].lat;
+            request["longitude"s] = coordinates[stop].lng;
+            request["road_distances"s] = std::move(road_distances);
+            base_requests.push_back(std::move(request));
+        }
+        for (size_t bus = 0; bus < params.bus_count; ++bus) {
+            // Некольцевой маршрут задаётся в одну сторону
+            json::Array stops;
+            for (size_t stop : routes[bus]) {
+                stops.push_back(StopName(stop));
+            }
+
+            json::Dict request;
+            request["type"s] = "Bus"s;
+            request["name"s] = BusName(bus);
+            request["stops"s] = std::move(stops);
+            request["is_roundtrip"s] = static_cast<bool>(roundtrips[bus]);
+            base_requests.push_back(std::move(request));
+        }
+
+        // Маршруты поездок строятся между остановками, через которые ходят автобусы
+        if (route_stops.empty()) {
+            route_stops.push_back(0);
+        }
+        const StatRequestMix& mix = params.stat_mix;
+        const double mix_total = mix.bus + mix.stop + mix.route + mix.map;
+        if (!(mix_total > 0.0)) {
+            throw std::invalid_argument("Stat request mix must have a positive total"s);
+        }
+
+        json::Array stat_requests;
+        stat_requests.reserve(params.stat_request_count);
+        for (size_t id = 1; id <= params.stat_request_count; ++id) {
+            json::Dict request;
+            request["id"s] = static_cast<int>(id);
+
+            const double choice = random.Uniform() * mix_total;
+            if (choice < mix.bus && params.bus_count > 0) {
+                request["type"s] = "Bus"s;
+                request["name"s] = BusName(random.Index(params.bus_count));
+            }
+            else if (choice < mix.bus + mix.stop) {
+                request["type"s] = "Stop"s;
+                request["name"s] = StopName(random.Index(params.stop_count));
+            }
+            else if (choice < mix.bus + mix.stop + mix.route) {
+                request["type"s] = "Route"s;
+                request["from"s] = StopName(route_stops[random.Index(route_stops.size())]);
+                request["to"s] = StopName(route_stops[random.Index(route_stops.size())]);
+            }
+            else {
+                request["type"s] = "Map"s;
+            }
+            stat_requests.push_back(std::move(request));
+        }
+
+        json::Dict root;
+        root["base_requests"s] = std::move(base_requests);
+        root["render_settings"s] = MakeRenderSettings();
+        root["routing_settings"s] = MakeRoutingSettings();
+        root["stat_requests"s] = std::move(stat_requests);
+        return json::Document(std::move(root));
+    }
+
+}  // namespace benchmark
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "json.h"
+
+#include <cstdint>
+
+namespace benchmark {
+
+    // Доли типов stat-запросов; нормируются на их сумму
+    struct StatRequestMix {
+        double bus = 0.3;
+        double stop = 0.3;
+        double route = 0.35;
+        double map = 0.05;
+    };
+
+    /*
+     * Параметры синтетического города. Остановки расставляются по сетке со случайным сдвигом,
+     * маршруты — случайные блуждания по соседним узлам сетки
+     */
+    struct CityParams {
+        size_t stop_count = 100;
+        size_t bus_count = 10;
+        // Число остановок в маршруте (для некольцевого — в одну сторону)
+        size_t min_route_length = 5;
+        size_t max_route_length = 20;
+        double roundtrip_share = 0.5;
+        // Сколько дополнительных расстояний до соседних остановок задаётся у каждой остановки сверх нужных маршрутам
+        size_t extra_distances_per_stop = 1;
+
+        size_t stat_request_count = 100;
+        StatRequestMix stat_mix;
+
+        uint64_t seed = 1;
+    };
+
+    // Строит входной документ со всеми четырьмя разделами: base_requests, render_settings, routing_settings и stat_requests.
+    // При одинаковых параметрах результат одинаков на любой платформе
+    json::Document GenerateCity(const CityParams& params);
+
+}  // namespace benchmark
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "graph.h"
+#include "route_engine.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+    /*
+     * Поиск маршрута алгоритмом Дейкстры отдельно для каждого запроса. Предрасчёта нет,
+     * память — O(V) на поток под рабочие массивы, которые переиспользуются между запросами.
+     * Поиск останавливается, как только извлечена конечная вершина
+     */
+    template <typename Weight>
+    class DijkstraRouter final : public RouteEngine<Weight> {
+    private:
+        using Graph = DirectedWeightedGraph<Weight>;
+
+    public:
+        explicit DijkstraRouter(const Graph& graph)
+            : graph_(graph) {
+        }
+
+        bool BuildRoute(VertexId from, VertexId to, RouteInfo<Weight>& route) const override;
+
+        // Веса читаются из графа при каждом поиске, обновлять нечего
+        void UpdateEdgeWeights(const std::vector<EdgeId>&, size_t) override {
+        }
+
+        memory_stats::Report MemoryStats() const override {
+            return { { "search_workspace_per_thread", EstimateMemory(graph_.GetVertexCount()) } };
+        }
+
+        // Оценка памяти рабочих массивов одного потока
+        static size_t EstimateMemory(size_t vertex_count) {
+            return vertex_count * (sizeof(Weight) + sizeof(EdgeId) + sizeof(uint64_t) + sizeof(QueueEntry));
+        }
+
+    private:
+        using QueueEntry = std::pair<Weight, VertexId>;
+
+        /*
+         * Рабочие массивы потока. Вершина считается достигнутой в текущем поиске, если её отметка
+         * равна номеру поиска, поэтому между поисками массивы не очищаются
+         */
+        struct Workspace {
+            std::vector<Weight> distance;
+            std::vector<EdgeId> prev_edge;
+            std::vector<uint64_t> reached_mark;
+            std::vector<QueueEntry> queue;
+            uint64_t search_mark = 0;
+        };
+
+        static Workspace& GetWorkspace(size_t vertex_count) {
+            thread_local Workspace workspace;
+            if (workspace.distance.size() < vertex_count) {
+                workspace.distance.resize(vertex_count);
+                workspace.prev_edge.resize(vertex_count);
+                workspace.reached_mark.resize(vertex_count, 0);
+            }
+            return workspace;
+        }
+
+        static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+
+        const Graph& graph_;
+    };
+
+    template <typename Weight>
+    bool DijkstraRouter<Weight>::BuildRoute(VertexId from, VertexId to, RouteInfo<Weight>& route) const {
+        Workspace& workspace = GetWorkspace(graph_.GetVertexCount());
+        const uint64_t mark = ++workspace.search_mark;
+        auto& queue = workspace.queue;
+        queue.clear();
+
+        auto reach = [&](VertexId vertex, Weight distance, EdgeId edge_id) {
+            workspace.reached_mark[vertex] = mark;
+            workspace.distance[vertex] = distance;
+            workspace.prev_edge[vertex] = edge_id;
+            queue.emplace_back(distance, vertex);
+            std::push_heap(queue.begin(), queue.end(), std::greater<>{});
+        };
+
+        reach(from, Weight{}, NO_EDGE);
+        bool found = false;
+        while (!queue.empty()) {
+            std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+            const auto [distance, vertex] = queue.back();
+            queue.pop_back();
+            if (distance > workspace.distance[vertex]) {
+                continue;
+            }
+            if (vertex == to) {
+                found = true;
+                break;
+            }
+            for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                const auto& edge = graph_.GetEdge(edge_id);
+                const Weight candidate = distance + edge.weight;
+                if (workspace.reached_mark[edge.to] != mark || candidate < workspace.distance[edge.to]) {
+                    reach(edge.to, candidate, edge_id);
+                }
+            }
+        }
+        if (!found) {
+            return false;
+        }
+
+        route.weight = workspace.distance[to];
+        route.edges.clear();
+        for (EdgeId edge_id = workspace.prev_edge[to]; edge_id != NO_EDGE;
+            edge_id = workspace.prev_edge[graph_.GetEdge(edge_id).from]) {
+            route.edges.push_back(edge_id);
+        }
+        std::reverse(route.edges.begin(), route.edges.end());
+        return true;
+    }
+
+}  // namespace graph
@@ -7,6 +7,8 @@ namespace transport_catalogue {
 	struct StopStation {
 		std::string name;
 		geo::Coordinates coordinates;
+		// Номер остановки в порядке добавления в справочник
+		size_t id = 0;
 	};
 
 	bool operator<(const StopStation& lhs, const StopStation& rhs);
@@ -15,6 +17,8 @@ namespace transport_catalogue {
 		std::string name;
 		std::vector<const StopStation*> route;
 		bool is_roundtrip;
+		// Номер автобуса в порядке добавления в справочник
+		size_t id = 0;
 	};
 
 	struct RouteInfo {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "memory_stats.h"
 #include "ranges.h"
 
 #include <cstdlib>
@@ -27,17 +28,32 @@ namespace graph {
         DirectedWeightedGraph() = default;
         explicit DirectedWeightedGraph(size_t vertex_count);
         EdgeId AddEdge(const Edge<Weight>& edge);
+        // Резервирует место под edge_count рёбер, чтобы массив рёбер не перевыделялся при добавлении
+        void ReserveEdges(size_t edge_count);
+        void SetEdgeWeight(EdgeId edge_id, Weight weight);
 
         size_t GetVertexCount() const;
         size_t GetEdgeCount() const;
         const Edge<Weight>& GetEdge(EdgeId edge_id) const;
         IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
 
+        // Оценка памяти рёбер и списков смежности
+        memory_stats::Report MemoryStats() const;
+
     private:
         std::vector<Edge<Weight>> edges_;
         std::vector<IncidenceList> incidence_lists_;
     };
 
+    template <typename Weight>
+    memory_stats::Report DirectedWeightedGraph<Weight>::MemoryStats() const {
+        size_t incidence_lists = memory_stats::HeapBytes(incidence_lists_);
+        for (const IncidenceList& list : incidence_lists_) {
+            incidence_lists += memory_stats::HeapBytes(list);
+        }
+        return { { "edges", memory_stats::HeapBytes(edges_) }, { "incidence_lists", incidence_lists } };
+    }
+
     template <typename Weight>
     DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count)
         : incidence_lists_(vertex_count) {
@@ -51,6 +67,16 @@ namespace graph {
         return id;
     }
 
+    template <typename Weight>
+    void DirectedWeightedGraph<Weight>::ReserveEdges(size_t edge_count) {
+        edges_.reserve(edge_count);
+    }
+
+    template <typename Weight>
+    void DirectedWeightedGraph<Weight>::SetEdgeWeight(EdgeId edge_id, Weight weight) {
+        edges_.at(edge_id).weight = weight;
+    }
+
     template <typename Weight>
     size_t DirectedWeightedGraph<Weight>::GetVertexCount() const {
         return incidence_lists_.size();
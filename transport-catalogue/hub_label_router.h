@@ -0,0 +1,528 @@
+#pragma once
+
+#include "graph.h"
+#include "profile.h"
+#include "route_engine.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+    /*
+     * Поиск маршрутов по меткам хабов (pruned landmark labeling). У каждой вершины две метки, упорядоченные
+     * по рангу хаба: прямая — расстояния от вершины до хабов, обратная — от хабов до вершины.
+     * Длина кратчайшего маршрута — минимум суммы расстояний по общим хабам, который находится слиянием
+     * двух меток без поиска по графу. Рёбра маршрута восстанавливаются по рёбрам, сохранённым в метках.
+     * Метки можно сохранить в файл и загружать при следующих запусках, пока граф (вершины, рёбра и веса) не изменился.
+     * Изменение весов не поддерживается: метки пришлось бы строить заново целиком, а это последовательный
+     * процесс на десятки секунд уже для сотен остановок, всё это время блокирующий запросы
+     */
+    template <typename Weight>
+    class HubLabelRouter final : public RouteEngine<Weight> {
+    private:
+        using Graph = DirectedWeightedGraph<Weight>;
+
+    public:
+        /*
+         * Если labels_path не пуст и файл построен для такого же графа, метки загружаются из него (счётчик hub_labels.loaded),
+         * иначе строятся и записываются в файл (hub_labels.built). Выбрасывает std::runtime_error, если файл
+         * не удалось записать или он повреждён
+         */
+        explicit HubLabelRouter(const Graph& graph, const std::string& labels_path = {});
+
+        bool BuildRoute(VertexId from, VertexId to, RouteInfo<Weight>& route) const override;
+
+        // Не вызывается, так как SupportsWeightUpdates() == false; выбрасывает std::logic_error
+        void UpdateEdgeWeights(const std::vector<EdgeId>& changed_edges, size_t thread_count) override;
+
+        bool SupportsWeightUpdates() const override {
+            return false;
+        }
+
+        memory_stats::Report MemoryStats() const override {
+            return { { "hub_labels_forward", out_labels_.MemoryBytes() }, { "hub_labels_backward", in_labels_.MemoryBytes() } };
+        }
+
+        // Оценка памяти без самих меток (их размер зависит от графа): смещения меток вершин
+        static size_t EstimateMemory(size_t vertex_count) {
+            return 2 * (vertex_count + 1) * sizeof(size_t);
+        }
+
+    private:
+        using QueueEntry = std::pair<Weight, VertexId>;
+
+        /*
+         * Метки всех вершин подряд: метка вершины v занимает позиции [offsets[v], offsets[v + 1]).
+         * edges — первое ребро пути от вершины к хабу (прямая метка) или последнее ребро пути
+         * от хаба к вершине (обратная); NO_EDGE у самого хаба
+         */
+        struct Labels {
+            std::vector<size_t> offsets;
+            std::vector<uint32_t> hubs;
+            std::vector<Weight> distances;
+            std::vector<EdgeId> edges;
+
+            size_t MemoryBytes() const {
+                return memory_stats::HeapBytes(offsets) + memory_stats::HeapBytes(hubs)
+                    + memory_stats::HeapBytes(distances) + memory_stats::HeapBytes(edges);
+            }
+        };
+
+        // Метка одной вершины во время построения
+        struct LabelBuffer {
+            std::vector<uint32_t> hubs;
+            std::vector<Weight> distances;
+            std::vector<EdgeId> edges;
+        };
+
+        struct BuildState {
+            // Входящие рёбра вершины v — incoming_edges[incoming_offsets[v]..incoming_offsets[v + 1])
+            std::vector<size_t> incoming_offsets;
+            std::vector<EdgeId> incoming_edges;
+            std::vector<LabelBuffer> out_labels;
+            std::vector<LabelBuffer> in_labels;
+
+            std::vector<Weight> distance;
+            std::vector<EdgeId> parent_edge;
+            std::vector<uint64_t> reached_mark;
+            std::vector<QueueEntry> queue;
+            // Метка корня текущего поиска по рангу хаба: значение действительно, если root_mark равен search_mark
+            std::vector<Weight> root_distance;
+            std::vector<uint64_t> root_mark;
+            uint64_t search_mark = 0;
+        };
+
+        void BuildLabels();
+
+        // forward: поиск из root по исходящим рёбрам, хаб root добавляется в обратные метки; иначе — к root по входящим, в прямые
+        void PrunedSearch(VertexId root, uint32_t rank, bool forward, BuildState& state) const;
+
+        static Labels Flatten(std::vector<LabelBuffer>& buffers);
+
+        // Позиция хаба hub в метке вершины vertex
+        size_t FindHub(const Labels& labels, VertexId vertex, uint32_t hub) const;
+
+        uint64_t ComputeFingerprint() const;
+
+        // Возвращает false, если файла нет или он построен для другого графа
+        bool Load(const std::string& path, uint64_t fingerprint);
+
+        void Save(const std::string& path, uint64_t fingerprint) const;
+
+        template <typename T>
+        static void WriteValue(std::ostream& out, const T& value) {
+            out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template <typename T>
+        static bool ReadValue(std::istream& in, T& value) {
+            return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+        }
+
+        template <typename T>
+        static void WriteVector(std::ostream& out, const std::vector<T>& values) {
+            WriteValue<uint64_t>(out, values.size());
+            out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+        }
+
+        // Число байтов от текущей позиции до конца потока; 0, если позицию узнать нельзя
+        static uint64_t GetRemainingBytes(std::istream& in) {
+            const std::streampos position = in.tellg();
+            if (position < 0) {
+                return 0;
+            }
+            in.seekg(0, std::ios::end);
+            const std::streampos end = in.tellg();
+            in.seekg(position);
+            return end > position ? static_cast<uint64_t>(end - position) : 0;
+        }
+
+        // Размер из файла проверяется до выделения памяти: не больше max_size и не больше, чем помещается
+        // в оставшиеся байты, поэтому повреждённый файл не приводит к огромному выделению
+        template <typename T>
+        static bool ReadVector(std::istream& in, std::vector<T>& values, uint64_t max_size) {
+            uint64_t size = 0;
+            if (!ReadValue(in, size) || size > max_size || size > GetRemainingBytes(in) / sizeof(T)) {
+                return false;
+            }
+            values.resize(size);
+            return static_cast<bool>(in.read(reinterpret_cast<char*>(values.data()), size * sizeof(T)));
+        }
+
+        static_assert(std::is_trivially_copyable_v<Weight>, "Hub labels are stored in a file as raw bytes");
+
+        // Заголовок файла: FILE_MAGIC, FILE_VERSION, размеры Weight и EdgeId, числа вершин и рёбер, отпечаток графа
+        static constexpr uint32_t FILE_MAGIC = 0x4C484354;  // "TCHL"
+        static constexpr uint32_t FILE_VERSION = 1;
+        static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+
+        const Graph& graph_;
+        Labels out_labels_;
+        Labels in_labels_;
+    };
+
+    template <typename Weight>
+    HubLabelRouter<Weight>::HubLabelRouter(const Graph& graph, const std::string& labels_path)
+        : graph_(graph)
+    {
+        if (graph_.GetVertexCount() >= std::numeric_limits<uint32_t>::max()) {
+            throw std::length_error("HubLabelRouter: too many vertices");
+        }
+
+        profile::ScopedPhase phase("router_precompute", profile::AllocationTag::ROUTER);
+        const uint64_t fingerprint = ComputeFingerprint();
+        if (!labels_path.empty() && Load(labels_path, fingerprint)) {
+            profile::AddCounter("hub_labels.loaded", 1);
+        }
+        else {
+            BuildLabels();
+            if (!labels_path.empty()) {
+                Save(labels_path, fingerprint);
+            }
+        }
+        profile::AddCounter("hub_labels.entries", out_labels_.hubs.size() + in_labels_.hubs.size());
+    }
+
+    /*
+     * Вершины обходятся по убыванию важности — произведения (входящая степень + 1) * (исходящая степень + 1).
+     * Поиск из очередной вершины не продолжается через вершину, расстояние до которой уже даётся
+     * метками более важных хабов, поэтому метки остаются короткими
+     */
+    template <typename Weight>
+    void HubLabelRouter<Weight>::BuildLabels() {
+        const size_t vertex_count = graph_.GetVertexCount();
+        const size_t edge_count = graph_.GetEdgeCount();
+
+        BuildState state;
+        state.incoming_offsets.assign(vertex_count + 1, 0);
+        std::vector<size_t> out_degree(vertex_count, 0);
+        for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            ++state.incoming_offsets[edge.to + 1];
+            ++out_degree[edge.from];
+        }
+        std::partial_sum(state.incoming_offsets.begin(), state.incoming_offsets.end(), state.incoming_offsets.begin());
+        state.incoming_edges.resize(edge_count);
+        std::vector<size_t> next_slot(state.incoming_offsets.begin(), state.incoming_offsets.end() - 1);
+        for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+            state.incoming_edges[next_slot[graph_.GetEdge(edge_id).to]++] = edge_id;
+        }
+
+        std::vector<VertexId> order(vertex_count);
+        std::iota(order.begin(), order.end(), 0);
+        auto importance = [&](VertexId vertex) {
+            return (state.incoming_offsets[vertex + 1] - state.incoming_offsets[vertex] + 1) * (out_degree[vertex] + 1);
+        };
+        std::stable_sort(order.begin(), order.end(), [&](VertexId lhs, VertexId rhs) {
+            return importance(lhs) > importance(rhs);
+        });
+
+        state.out_labels.resize(vertex_count);
+        state.in_labels.resize(vertex_count);
+        state.distance.resize(vertex_count);
+        state.parent_edge.resize(vertex_count);
+        state.reached_mark.assign(vertex_count, 0);
+        state.root_distance.resize(vertex_count);
+        state.root_mark.assign(vertex_count, 0);
+        for (uint32_t rank = 0; rank < vertex_count; ++rank) {
+            PrunedSearch(order[rank], rank, true, state);
+            PrunedSearch(order[rank], rank, false, state);
+        }
+
+        out_labels_ = Flatten(state.out_labels);
+        in_labels_ = Flatten(state.in_labels);
+        profile::AddCounter("hub_labels.built", 1);
+    }
+
+    template <typename Weight>
+    void HubLabelRouter<Weight>::PrunedSearch(VertexId root, uint32_t rank, bool forward, BuildState& state) const {
+        const uint64_t mark = ++state.search_mark;
+        const LabelBuffer& root_label = forward ? state.out_labels[root] : state.in_labels[root];
+        for (size_t i = 0; i < root_label.hubs.size(); ++i) {
+            state.root_distance[root_label.hubs[i]] = root_label.distances[i];
+            state.root_mark[root_label.hubs[i]] = mark;
+        }
+        std::vector<LabelBuffer>& labels = forward ? state.in_labels : state.out_labels;
+
+        auto& queue = state.queue;
+        queue.clear();
+        auto reach = [&](VertexId vertex, Weight distance, EdgeId edge_id) {
+            state.reached_mark[vertex] = mark;
+            state.distance[vertex] = distance;
+            state.parent_edge[vertex] = edge_id;
+            queue.emplace_back(distance, vertex);
+            std::push_heap(queue.begin(), queue.end(), std::greater<>{});
+        };
+        auto relax = [&](Weight distance, EdgeId edge_id, VertexId next) {
+            const Weight candidate = distance + graph_.GetEdge(edge_id).weight;
+            if (state.reached_mark[next] != mark || candidate < state.distance[next]) {
+                reach(next, candidate, edge_id);
+            }
+        };
+
+        reach(root, Weight{}, NO_EDGE);
+        while (!queue.empty()) {
+            std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+            const auto [distance, vertex] = queue.back();
+            queue.pop_back();
+            if (distance > state.distance[vertex]) {
+                continue;
+            }
+
+            LabelBuffer& label = labels[vertex];
+            bool covered = false;
+            for (size_t i = 0; i < label.hubs.size() && !covered; ++i) {
+                const uint32_t hub = label.hubs[i];
+                covered = state.root_mark[hub] == mark && state.root_distance[hub] + label.distances[i] <= distance;
+            }
+            if (covered) {
+                continue;
+            }
+            label.hubs.push_back(rank);
+            label.distances.push_back(distance);
+            label.edges.push_back(state.parent_edge[vertex]);
+
+            if (forward) {
+                for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                    relax(distance, edge_id, graph_.GetEdge(edge_id).to);
+                }
+            }
+            else {
+                for (size_t i = state.incoming_offsets[vertex]; i < state.incoming_offsets[vertex + 1]; ++i) {
+                    const EdgeId edge_id = state.incoming_edges[i];
+                    relax(distance, edge_id, graph_.GetEdge(edge_id).from);
+                }
+            }
+        }
+    }
+
+    template <typename Weight>
+    typename HubLabelRouter<Weight>::Labels HubLabelRouter<Weight>::Flatten(std::vector<LabelBuffer>& buffers) {
+        Labels labels;
+        labels.offsets.reserve(buffers.size() + 1);
+        size_t entry_count = 0;
+        for (const LabelBuffer& buffer : buffers) {
+            entry_count += buffer.hubs.size();
+        }
+        labels.hubs.reserve(entry_count);
+        labels.distances.reserve(entry_count);
+        labels.edges.reserve(entry_count);
+        for (LabelBuffer& buffer : buffers) {
+            labels.offsets.push_back(labels.hubs.size());
+            labels.hubs.insert(labels.hubs.end(), buffer.hubs.begin(), buffer.hubs.end());
+            labels.distances.insert(labels.distances.end(), buffer.distances.begin(), buffer.distances.end());
+            labels.edges.insert(labels.edges.end(), buffer.edges.begin(), buffer.edges.end());
+            buffer = {};
+        }
+        labels.offsets.push_back(labels.hubs.size());
+        return labels;
+    }
+
+    template <typename Weight>
+    size_t HubLabelRouter<Weight>::FindHub(const Labels& labels, VertexId vertex, uint32_t hub) const {
+        const auto begin = labels.hubs.begin() + labels.offsets[vertex];
+        const auto end = labels.hubs.begin() + labels.offsets[vertex + 1];
+        const auto it = std::lower_bound(begin, end, hub);
+        if (it == end || *it != hub) {
+            throw std::logic_error("HubLabelRouter: a vertex on the route has no label for the hub");
+        }
+        return it - labels.hubs.begin();
+    }
+
+    template <typename Weight>
+    bool HubLabelRouter<Weight>::BuildRoute(VertexId from, VertexId to, RouteInfo<Weight>& route) const {
+        // Слияние прямой метки from и обратной метки to по возрастанию рангов хабов
+        size_t out_pos = out_labels_.offsets[from];
+        const size_t out_end = out_labels_.offsets[from + 1];
+        size_t in_pos = in_labels_.offsets[to];
+        const size_t in_end = in_labels_.offsets[to + 1];
+        bool found = false;
+        Weight best_weight{};
+        uint32_t best_hub = 0;
+        while (out_pos < out_end && in_pos < in_end) {
+            const uint32_t out_hub = out_labels_.hubs[out_pos];
+            const uint32_t in_hub = in_labels_.hubs[in_pos];
+            if (out_hub < in_hub) {
+                ++out_pos;
+            }
+            else if (in_hub < out_hub) {
+                ++in_pos;
+            }
+            else {
+                const Weight weight = out_labels_.distances[out_pos] + in_labels_.distances[in_pos];
+                if (!found || weight < best_weight) {
+                    found = true;
+                    best_weight = weight;
+                    best_hub = out_hub;
+                }
+                ++out_pos;
+                ++in_pos;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+
+        // От from до хаба — по прямым меткам, от to назад до хаба — по обратным.
+        // Кратчайший путь короче числа вершин; более длинная цепочка рёбер бывает только у испорченных меток
+        const size_t max_steps = graph_.GetVertexCount();
+        route.edges.clear();
+        for (VertexId vertex = from;;) {
+            const EdgeId edge_id = out_labels_.edges[FindHub(out_labels_, vertex, best_hub)];
+            if (edge_id == NO_EDGE) {
+                break;
+            }
+            if (route.edges.size() >= max_steps) {
+                throw std::logic_error("HubLabelRouter: the route to the hub does not end");
+            }
+            route.edges.push_back(edge_id);
+            vertex = graph_.GetEdge(edge_id).to;
+        }
+        const size_t hub_position = route.edges.size();
+        for (VertexId vertex = to;;) {
+            const EdgeId edge_id = in_labels_.edges[FindHub(in_labels_, vertex, best_hub)];
+            if (edge_id == NO_EDGE) {
+                break;
+            }
+            if (route.edges.size() - hub_position >= max_steps) {
+                throw std::logic_error("HubLabelRouter: the route from the hub does not end");
+            }
+            route.edges.push_back(edge_id);
+            vertex = graph_.GetEdge(edge_id).from;
+        }
+        std::reverse(route.edges.begin() + hub_position, route.edges.end());
+
+        // Вес складывается по рёбрам в порядке следования, как при обычном поиске
+        route.weight = Weight{};
+        for (const EdgeId edge_id : route.edges) {
+            route.weight += graph_.GetEdge(edge_id).weight;
+        }
+        return true;
+    }
+
+    template <typename Weight>
+    void HubLabelRouter<Weight>::UpdateEdgeWeights(const std::vector<EdgeId>&, size_t) {
+        throw std::logic_error("HubLabelRouter: edge weights cannot be changed");
+    }
+
+    // FNV-1a по числу вершин и концам и весам всех рёбер
+    template <typename Weight>
+    uint64_t HubLabelRouter<Weight>::ComputeFingerprint() const {
+        uint64_t hash = 14695981039346656037ull;
+        auto add_bytes = [&hash](const void* data, size_t size) {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+        };
+        const uint64_t vertex_count = graph_.GetVertexCount();
+        add_bytes(&vertex_count, sizeof(vertex_count));
+        for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            const uint64_t ends[2] = { edge.from, edge.to };
+            add_bytes(ends, sizeof(ends));
+            add_bytes(&edge.weight, sizeof(edge.weight));
+        }
+        return hash;
+    }
+
+    template <typename Weight>
+    bool HubLabelRouter<Weight>::Load(const std::string& path, uint64_t fingerprint) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            return false;
+        }
+
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        uint32_t weight_size = 0;
+        uint32_t edge_id_size = 0;
+        uint64_t vertex_count = 0;
+        uint64_t edge_count = 0;
+        uint64_t file_fingerprint = 0;
+        if (!ReadValue(in, magic) || !ReadValue(in, version) || !ReadValue(in, weight_size) || !ReadValue(in, edge_id_size)
+            || !ReadValue(in, vertex_count) || !ReadValue(in, edge_count) || !ReadValue(in, file_fingerprint)) {
+            return false;
+        }
+        if (magic != FILE_MAGIC || version != FILE_VERSION || weight_size != sizeof(Weight) || edge_id_size != sizeof(EdgeId)
+            || vertex_count != graph_.GetVertexCount() || edge_count != graph_.GetEdgeCount() || file_fingerprint != fingerprint) {
+            return false;
+        }
+
+        // Число записей меток известно из последнего смещения, им ограничены размеры остальных векторов
+        auto read_labels = [&](Labels& labels) {
+            if (!ReadVector(in, labels.offsets, vertex_count + 1) || labels.offsets.size() != vertex_count + 1
+                || labels.offsets.front() != 0 || !std::is_sorted(labels.offsets.begin(), labels.offsets.end())) {
+                return false;
+            }
+            const size_t entry_count = labels.offsets.back();
+            if (!ReadVector(in, labels.hubs, entry_count) || !ReadVector(in, labels.distances, entry_count)
+                || !ReadVector(in, labels.edges, entry_count)) {
+                return false;
+            }
+            if (labels.hubs.size() != entry_count || labels.distances.size() != entry_count || labels.edges.size() != entry_count
+                || !std::all_of(labels.hubs.begin(), labels.hubs.end(), [&](uint32_t hub) { return hub < vertex_count; })
+                || !std::all_of(labels.edges.begin(), labels.edges.end(), [&](EdgeId edge_id) { return edge_id == NO_EDGE || edge_id < edge_count; })) {
+                return false;
+            }
+            // Слияние меток в BuildRoute и поиск хаба в FindHub рассчитаны на строго возрастающие ранги хабов
+            for (size_t vertex = 0; vertex < vertex_count; ++vertex) {
+                const auto begin = labels.hubs.begin() + labels.offsets[vertex];
+                const auto end = labels.hubs.begin() + labels.offsets[vertex + 1];
+                if (std::adjacent_find(begin, end, std::greater_equal<>{}) != end) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        if (!read_labels(out_labels_) || !read_labels(in_labels_)) {
+            throw std::runtime_error("Hub labels file is corrupted: " + path);
+        }
+        return true;
+    }
+
+    // Файл записывается рядом под временным именем и затем переименовывается, поэтому оборванная запись не портит прежний
+    template <typename Weight>
+    void HubLabelRouter<Weight>::Save(const std::string& path, uint64_t fingerprint) const {
+        const std::string temp_path = path + ".tmp";
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            if (!out) {
+                throw std::runtime_error("Failed to open hub labels file " + temp_path);
+            }
+            WriteValue(out, FILE_MAGIC);
+            WriteValue(out, FILE_VERSION);
+            WriteValue<uint32_t>(out, sizeof(Weight));
+            WriteValue<uint32_t>(out, sizeof(EdgeId));
+            WriteValue<uint64_t>(out, graph_.GetVertexCount());
+            WriteValue<uint64_t>(out, graph_.GetEdgeCount());
+            WriteValue(out, fingerprint);
+            for (const Labels* labels : { &out_labels_, &in_labels_ }) {
+                WriteVector(out, labels->offsets);
+                WriteVector(out, labels->hubs);
+                WriteVector(out, labels->distances);
+                WriteVector(out, labels->edges);
+            }
+            if (!out.flush()) {
+                throw std::runtime_error("Failed to write hub labels file " + temp_path);
+            }
+        }
+        if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+            std::remove(temp_path.c_str());
+            throw std::runtime_error("Failed to replace hub labels file " + path);
+        }
+    }
+
+}  // namespace graph
@@ -237,15 +237,26 @@ namespace json {
             std::ostream& out;
             int indent_step = 4;
             int indent = 0;
+            // В компактном режиме документ выводится одной строкой без отступов
+            bool compact = false;
 
             void PrintIndent() const {
+                if (compact) {
+                    return;
+                }
                 for (int i = 0; i < indent; ++i) {
                     out.put(' ');
                 }
             }
 
+            void PrintLineBreak() const {
+                if (!compact) {
+                    out.put('\n');
+                }
+            }
+
             PrintContext Indented() const {
-                return { out, indent_step, indent_step + indent };
+                return { out, indent_step, indent_step + indent, compact };
             }
         };
 
@@ -305,7 +316,8 @@ namespace json {
         template <>
         void PrintValue<Array>(const Array& nodes, const PrintContext& ctx) {
             std::ostream& out = ctx.out;
-            out << "[\n"sv;
+            out.put('[');
+            ctx.PrintLineBreak();
             bool first = true;
             auto inner_ctx = ctx.Indented();
             for (const Node& node : nodes) {
@@ -313,12 +325,13 @@ namespace json {
                     first = false;
                 }
                 else {
-                    out << ",\n"sv;
+                    out.put(',');
+                    ctx.PrintLineBreak();
                 }
                 inner_ctx.PrintIndent();
                 PrintNode(node, inner_ctx);
             }
-            out.put('\n');
+            ctx.PrintLineBreak();
             ctx.PrintIndent();
             out.put(']');
         }
@@ -326,7 +339,8 @@ namespace json {
         template <>
         void PrintValue<Dict>(const Dict& nodes, const PrintContext& ctx) {
             std::ostream& out = ctx.out;
-            out << "{\n"sv;
+            out.put('{');
+            ctx.PrintLineBreak();
             bool first = true;
             auto inner_ctx = ctx.Indented();
             for (const auto& [key, node] : nodes) {
@@ -334,14 +348,15 @@ namespace json {
                     first = false;
                 }
                 else {
-                    out << ",\n"sv;
+                    out.put(',');
+                    ctx.PrintLineBreak();
                 }
                 inner_ctx.PrintIndent();
                 PrintString(key, ctx.out);
-                out << ": "sv;
+                out << (ctx.compact ? ":"sv : ": "sv);
                 PrintNode(node, inner_ctx);
             }
-            out.put('\n');
+            ctx.PrintLineBreak();
             ctx.PrintIndent();
             out.put('}');
         }
@@ -356,6 +371,45 @@ namespace json {
 
     }
 
+    namespace {
+        void AddMemoryStats(const Node& node, memory_stats::Report& report);
+
+        void AddMemoryStats(const Dict& dict, memory_stats::Report& report) {
+            report["dicts"] += memory_stats::HeapBytes(dict);
+            for (const auto& [key, value] : dict) {
+                report["strings"] += memory_stats::HeapBytes(key);
+                AddMemoryStats(value, report);
+            }
+        }
+
+        void AddMemoryStats(const Node& node, memory_stats::Report& report) {
+            if (node.IsString()) {
+                report["strings"] += memory_stats::HeapBytes(node.AsString());
+            }
+            else if (node.IsArray()) {
+                report["arrays"] += memory_stats::HeapBytes(node.AsArray());
+                for (const Node& item : node.AsArray()) {
+                    AddMemoryStats(item, report);
+                }
+            }
+            else if (node.IsDict()) {
+                AddMemoryStats(node.AsDict(), report);
+            }
+        }
+    }
+
+    memory_stats::Report Document::MemoryStats() const {
+        memory_stats::Report report{ { "arrays", 0 }, { "dicts", 0 }, { "strings", 0 } };
+        AddMemoryStats(root_, report);
+        return report;
+    }
+
+    memory_stats::Report MemoryStats(const Dict& dict) {
+        memory_stats::Report report{ { "arrays", 0 }, { "dicts", 0 }, { "strings", 0 } };
+        AddMemoryStats(dict, report);
+        return report;
+    }
+
     Document Load(std::istream& input) {
         return Document{ LoadNode(input) };
     }
@@ -364,4 +418,8 @@ namespace json {
         PrintNode(doc.GetRoot(), PrintContext{ output });
     }
 
+    void PrintCompact(const Document& doc, std::ostream& output) {
+        PrintNode(doc.GetRoot(), PrintContext{ output, 0, 0, true });
+    }
+
 }
\ No newline at end of file
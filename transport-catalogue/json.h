@@ -1,5 +1,7 @@
 #pragma once
 
+#include "memory_stats.h"
+
 #include <iostream>
 #include <map>
 #include <string>
@@ -129,10 +131,16 @@ namespace json {
             return root_;
         }
 
+        // Оценка памяти дерева: строки (значения и ключи), массивы и узлы словарей
+        memory_stats::Report MemoryStats() const;
+
     private:
         Node root_;
     };
 
+    // Оценка памяти словаря, хранящегося вне документа
+    memory_stats::Report MemoryStats(const Dict& dict);
+
     inline bool operator==(const Document& lhs, const Document& rhs) {
         return lhs.GetRoot() == rhs.GetRoot();
     }
@@ -145,4 +153,7 @@ namespace json {
 
     void Print(const Document& doc, std::ostream& output);
 
+    // Выводит документ одной строкой (без переводов строк и отступов)
+    void PrintCompact(const Document& doc, std::ostream& output);
+
 }
\ No newline at end of file
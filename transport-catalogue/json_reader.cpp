@@ -1,5 +1,7 @@
 #include "json_reader.h"
 
+#include <limits>
+
 namespace json_reader {
 
 	//-------------------------------------------------------------------
@@ -9,7 +11,13 @@ namespace json_reader {
 	inline std::string error_messeg_base_requests_stop = "JsonReader(ApplyStopInfo): The dictionary that describes \"Stop\" is missing the key "s;
 	inline std::string error_messeg_base_requests_bus = "JsonReader(ApplyBusInfo): The dictionary that describes \"Bus\" is missing the key "s;
 
+	json::Document JsonReader::LoadInput(std::istream& input) {
+		profile::ScopedPhase phase("json_load", profile::AllocationTag::PARSE);
+		return json::Load(input);
+	}
+
 	transport_catalogue::TransportCatalogue JsonReader::ApplyBaseRequests() const {
+		profile::ScopedPhase phase("apply_base_requests", profile::AllocationTag::INGEST);
 		auto base_requests = json_.find(base_key);
 		if (base_requests == json_.end()) {
 			throw std::logic_error("The dictionary is missing a key\"" + base_key + "\"");
@@ -143,6 +151,8 @@ namespace json_reader {
 		ApplyStopLabel(dict, rs);
 		ApplyUnderlayer(dict, rs);
 		ApplyColorPalette(dict, rs);
+		ApplyPolylineSimplification(dict, rs);
+		ApplyOutputFormat(dict, rs);
 		return rs;
 	}
 
@@ -316,6 +326,54 @@ namespace json_reader {
 		rs.color_palette_ = result;
 	}
 
+	void JsonReader::ApplyPolylineSimplification(const json::Dict& dict, map_renderer::RenderSettings& rs) const {
+		// Optional keys: without them every stop of every route is drawn
+		auto it_simplification = dict.find("polyline_simplification"s);
+		if (it_simplification == dict.end()) {
+			return;
+		}
+
+		const std::string& simplification = it_simplification->second.AsString();
+		if (simplification == "none"s) {
+			rs.polyline_simplification_ = map_renderer::PolylineSimplification::NONE;
+		}
+		else if (simplification == "douglas_peucker"s) {
+			rs.polyline_simplification_ = map_renderer::PolylineSimplification::DOUGLAS_PEUCKER;
+		}
+		else if (simplification == "pixel_grid"s) {
+			rs.polyline_simplification_ = map_renderer::PolylineSimplification::PIXEL_GRID;
+		}
+		else {
+			throw std::invalid_argument("Polyline_simplification must be \"none\", \"douglas_peucker\" or \"pixel_grid\""s);
+		}
+
+		// Apply polyline_tolerance
+		auto it_tolerance = dict.find("polyline_tolerance"s);
+		if (it_tolerance == dict.end()) {
+			throw std::logic_error(error_messeg_render_setting + "\"polyline_tolerance\""s);
+		}
+		double tolerance = it_tolerance->second.AsDouble();
+		if (!(tolerance >= 0.0 && tolerance <= 100000.0)) {
+			throw std::invalid_argument("Polyline_tolerance must be in range [0, 100000]"s);
+		}
+		rs.polyline_tolerance_ = tolerance;
+	}
+
+	void JsonReader::ApplyOutputFormat(const json::Dict& dict, map_renderer::RenderSettings& rs) const {
+		// Optional keys: without them the map is written exactly as before
+		if (auto it = dict.find("css_styles"s); it != dict.end()) {
+			rs.css_styles_ = it->second.AsBool();
+		}
+
+		if (auto it = dict.find("coordinate_precision"s); it != dict.end()) {
+			int precision = it->second.AsInt();
+			if (precision < 0 || precision > 15) {
+				throw std::invalid_argument("Coordinate_precision must be in range [0, 15]"s);
+			}
+			rs.coordinate_precision_ = precision;
+		}
+	}
+
 	const svg::Color JsonReader::ParseColorFromJson(const json::Node& clr) const {
 		svg::Color result;
 
@@ -384,120 +442,275 @@ namespace json_reader {
 		}
 		rs.bus_velocity = bus_velocity;
 
+		// Optional: drop parallel bus edges that are never faster than another edge between the same vertices
+		if (auto it = dict.find("prune_parallel_edges"s); it != dict.end()) {
+			rs.prune_parallel_edges = it->second.AsBool();
+		}
+
+		// Optional: number of recent Route results kept in the router's cache, 0 disables the cache
+		if (auto it = dict.find("route_cache_size"s); it != dict.end()) {
+			int route_cache_size = it->second.AsInt();
+			if (route_cache_size < 0) {
+				throw std::invalid_argument("Route_cache_size must be non-negative"s);
+			}
+			rs.route_cache_size = static_cast<size_t>(route_cache_size);
+		}
+
+		// Optional: routing engine, "auto" picks the all-pairs table only if it fits into "memory_budget_mb"
+		if (auto it = dict.find("engine"s); it != dict.end()) {
+			const std::string& engine = it->second.AsString();
+			if (engine == "auto"s) {
+				rs.engine = graph::RouterEngine::AUTO;
+			}
+			else if (engine == "all_pairs"s) {
+				rs.engine = graph::RouterEngine::ALL_PAIRS;
+			}
+			else if (engine == "dijkstra"s) {
+				rs.engine = graph::RouterEngine::DIJKSTRA;
+			}
+			else if (engine == "partition"s) {
+				rs.engine = graph::RouterEngine::PARTITION;
+			}
+			else if (engine == "hub_labels"s) {
+				rs.engine = graph::RouterEngine::HUB_LABELS;
+			}
+			else {
+				throw std::invalid_argument("Unknown routing engine \""s + engine + "\""s);
+			}
+		}
+
+		if (auto it = dict.find("memory_budget_mb"s); it != dict.end()) {
+			int memory_budget_mb = it->second.AsInt();
+			if (memory_budget_mb < 0) {
+				throw std::invalid_argument("Memory_budget_mb must be non-negative"s);
+			}
+			rs.memory_budget_mb = static_cast<size_t>(memory_budget_mb);
+		}
+
+		// Optional: largest number of graph vertices in one cell of the "partition" engine
+		if (auto it = dict.find("partition_cell_size"s); it != dict.end()) {
+			int partition_cell_size = it->second.AsInt();
+			if (partition_cell_size < 1) {
+				throw std::invalid_argument("Partition_cell_size must be positive"s);
+			}
+			rs.partition_cell_size = static_cast<size_t>(partition_cell_size);
+		}
+
+		// Optional: file of the "hub_labels" engine, reused while the routing graph stays the same
+		if (auto it = dict.find("hub_labels_file"s); it != dict.end()) {
+			rs.hub_labels_file = it->second.AsString();
+		}
+
 		return rs;
 	}
 
 	//-------------------------------------------------------------------
 	//----------------------Function Stat Info---------------------------
 	//-------------------------------------------------------------------
+	namespace {
+		// Requests that change the edge weights of the router; the answers to later requests depend on them
+		bool IsMutatingRequest(const json::Dict& request) {
+			auto it_type = request.find("type");
+			if (it_type == request.end() || !it_type->second.IsString()) {
+				return false;
+			}
+			const std::string& type = it_type->second.AsString();
+			return type == "SetVelocity" || type == "SetRoutingSettings";
+		}
+	}
+
 	const json::Document JsonReader::StatInfo(const transport_catalogue::TransportCatalogue& catalogue, 
 		const RequestHandler& rh,
-		const graph::TransportRouter<double>& tr) const {
+		graph::LazyTransportRouter<double>& tr,
+		size_t thread_count) const {
 		auto stat_requests = json_.find(stat_key);
 		if (stat_requests == json_.end()) {
 			throw std::logic_error("The dictionary is missing a key\"" + stat_key + "\"");
 		}
 
-		const json::Array array = stat_requests->second.AsArray();
+		const json::Array& array = stat_requests->second.AsArray();
+
+		// Each response goes into its own slot, so the output order matches the request order
+		// regardless of which thread answered the request. The read-only requests between two mutating ones
+		// are answered concurrently; a mutating request runs alone once all requests before it are answered.
+		// The pool threads live for the whole batch, so their route workspaces are reused across the barriers
+		std::vector<std::optional<json::Node>> slots(array.size());
+		parallel::ThreadPool pool(std::min(thread_count, array.size()));
+		const graph::LazyTransportRouter<double>& const_tr = tr;
+		size_t begin = 0;
+		while (begin < array.size()) {
+			size_t end = begin;
+			while (end < array.size() && !IsMutatingRequest(array[end].AsDict())) {
+				++end;
+			}
+			pool.ForEachIndex(end - begin, [&](size_t index) {
+				slots[begin + index] = StatRequestInfo(array[begin + index].AsDict(), catalogue, rh, const_tr);
+			});
+			if (end < array.size()) {
+				slots[end] = MutatingRequestInfo(array[end].AsDict(), tr);
+				++end;
+			}
+			begin = end;
+		}
 
 		json::Array stat_info;
-		for (const json::Node& a : array) {
-			json::Dict map;
+		stat_info.reserve(slots.size());
+		for (auto& slot : slots) {
+			if (slot.has_value()) {
+				stat_info.push_back(std::move(*slot));
+			}
+		}
 
-			map = a.AsDict();
+		return json::Document(stat_info);
+	}
+
+	json::Node JsonReader::AnswerStatRequest(const json::Dict& request,
+		const transport_catalogue::TransportCatalogue& catalogue,
+		const RequestHandler& rh,
+		graph::LazyTransportRouter<double>& tr) const {
+		if (IsMutatingRequest(request)) {
+			return MutatingRequestInfo(request, tr);
+		}
+		std::optional<json::Node> result = StatRequestInfo(request, catalogue, rh, tr);
+		if (!result.has_value()) {
+			throw std::logic_error("Unknown \"type\" of \"stat_request\"");
+		}
+		return std::move(*result);
+	}
+
+	std::optional<json::Node> JsonReader::StatRequestInfo(const json::Dict& map,
+		const transport_catalogue::TransportCatalogue& catalogue,
+		const RequestHandler& rh,
+		const graph::LazyTransportRouter<double>& tr) const {
+		auto it_id = map.find("id");
+		if (it_id == map.end()) {
+			throw std::logic_error("Missing \"id\" field in \"stat_request\"");
+		}
+
+		auto it_type = map.find("type");
+		if (it_type == map.end()) {
+			throw std::logic_error("Missing \"type\" field in \"stat_request\"");
+		}
+
+		profile::ScopedPhase phase(it_type->second.AsString(), profile::AllocationTag::STATS, profile::ScopedPhase::Kind::REQUEST);
+
+		if (it_type->second.AsString() == "Map") {
+			return StatMapInfo(it_id->second.AsInt(), rh);
+		}
+
+		if (it_type->second.AsString() == "Memory") {
+			return StatMemoryInfo(it_id->second.AsInt(), catalogue, tr);
+		}
 
-			auto it_id = map.find("id");
-			if (it_id == map.end()) {
-				throw std::logic_error("Missing \"id\" field in \"stat_request\"");
+		if (it_type->second.AsString() == "MapTile") {
+			return StatMapTileInfo(it_id->second.AsInt(), map, rh);
+		}
+
+		if (it_type->second.AsString() == "Route" || it_type->second.AsString() == "RouteMap") {
+			auto it_from = map.find("from");
+			if (it_from == map.end()) {
+				throw std::logic_error("Missing \"from\" field in \"stat_request\"");
 			}
 
-			auto it_type = map.find("type");
-			if (it_type == map.end()) {
-				throw std::logic_error("Missing \"type\" field in \"stat_request\"");
+			auto it_to = map.find("to");
+			if (it_to == map.end()) {
+				throw std::logic_error("Missing \"to\" field in \"stat_request\"");
 			}
 
-			if (it_type->second.AsString() == "Map") {
-				stat_info.push_back(StatMapInfo(it_id->second.AsInt(), rh));
-				continue;
+			if (it_type->second.AsString() == "RouteMap") {
+				return StatRouteMapInfo(it_id->second.AsInt(), it_from->second.AsString(), it_to->second.AsString(), catalogue, rh, tr);
 			}
+			return StatRouteInfo(it_id->second.AsInt(), it_from->second.AsString(), it_to->second.AsString(), tr);
+		}
 
-			if (it_type->second.AsString() == "Route") {
-				auto it_from = map.find("from");
-				if (it_from == map.end()) {
-					throw std::logic_error("Missing \"from\" field in \"stat_request\"");
-				}
+		auto it_name = map.find("name");
+		if (it_name == map.end()) {
+			throw std::logic_error("Missing \"name\" field in \"stat_request\"");
+		}
 
-				auto it_to = map.find("to");
-				if (it_to == map.end()) {
-					throw std::logic_error("Missing \"to\" field in \"stat_request\"");
-				}
+		if (it_type->second.AsString() == "Stop") {
+			return StatStopInfo(it_id->second.AsInt(), it_name->second.AsString(), catalogue);
+		}
+		else if (it_type->second.AsString() == "Bus") {
+			return StatBusInfo(it_id->second.AsInt(), it_name->second.AsString(), catalogue);
+		}
+
+		return std::nullopt;
+	}
+
+	// Only called for requests accepted by IsMutatingRequest, so "type" is present
+	json::Node JsonReader::MutatingRequestInfo(const json::Dict& map, graph::LazyTransportRouter<double>& tr) const {
+		auto it_id = map.find("id");
+		if (it_id == map.end()) {
+			throw std::logic_error("Missing \"id\" field in \"stat_request\"");
+		}
+
+		const std::string& type = map.at("type").AsString();
+		profile::ScopedPhase phase(type, profile::AllocationTag::STATS, profile::ScopedPhase::Kind::REQUEST);
+
+		if (type == "SetVelocity") {
+			return StatSetVelocityInfo(it_id->second.AsInt(), map, tr);
+		}
+
+		if (type == "SetRoutingSettings") {
+			return StatSetRoutingSettingsInfo(it_id->second.AsInt(), map, tr);
+		}
+
+		throw std::logic_error("Unknown \"type\" of \"stat_request\"");
+	}
+
+	const json::Dict JsonReader::StatRouteInfo(int id, const std::string& from, const std::string& to, const graph::LazyTransportRouter<double>& tr) const {
+		// Each worker thread reuses its own search buffers from request to request
+		thread_local graph::TransportRouter<double>::RouteWorkspace workspace;
+		json::Dict result;
 
-				auto route_result = tr.FindRoute(it_from->second.AsString(), it_to->second.AsString());
-				json::Dict result;
-
-				if (route_result.has_value()) {  // Проверяем, что маршрут найден
-					// Создаем массив для элементов маршрута
-					json::Array items;
-
-					for (const auto& item : route_result->items) {
-						if (item.type == graph::TransportRouter<double>::RouteItem::Type::WAIT) {
-							// Элемент "Wait"
-							items.push_back(json::Dict{
-								{"type", "Wait"},
-								{"stop_name", item.stop_name},
-								{"time", item.time}
-								});
-						}
-						else {
-							// Элемент "Bus"
-							items.push_back(json::Dict{
-								{"type", "Bus"},
-								{"bus", item.bus_name},
-								{"span_count", item.span_count},
-								{"time", item.time}
-								});
-						}
-					}
-
-					// Формируем финальный ответ
-					result = json::Builder{}
-						.StartDict()
-						.Key("request_id").Value(it_id->second.AsInt())
-						.Key("total_time").Value(route_result->total_time)
-						.Key("items").Value(items)
-						.EndDict()
-						.Build()
-						.AsDict();
+		if (tr.FindRoute(from, to, workspace)) {  // Проверяем, что маршрут найден
+			const auto& route_result = workspace.result;
+			// Создаем массив для элементов маршрута
+			json::Array items;
+
+			for (const auto& item : route_result.items) {
+				if (item.type == graph::TransportRouter<double>::RouteItem::Type::WAIT) {
+					// Элемент "Wait"
+					items.push_back(json::Dict{
+						{"type", "Wait"},
+						{"stop_name", std::string(item.name)},
+						{"time", item.time}
+						});
 				}
 				else {
-					// Если маршрут не найден
-					result = json::Builder{}
-						.StartDict()
-						.Key("request_id").Value(it_id->second.AsInt())
-						.Key("error_message").Value("not found")
-						.EndDict()
-						.Build()
-						.AsDict();
+					// Элемент "Bus"
+					items.push_back(json::Dict{
+						{"type", "Bus"},
+						{"bus", std::string(item.name)},
+						{"span_count", item.span_count},
+						{"time", item.time}
+						});
 				}
-
-				stat_info.push_back(result);
-				continue;
-			}
-
-			auto it_name = map.find("name");
-			if (it_name == map.end()) {
-				throw std::logic_error("Missing \"name\" field in \"stat_request\"");
 			}
 
-			if (it_type->second.AsString() == "Stop") {
-				stat_info.push_back(StatStopInfo(it_id->second.AsInt(), it_name->second.AsString(), catalogue));
-			}
-			else if (it_type->second.AsString() == "Bus") {
-				stat_info.push_back(StatBusInfo(it_id->second.AsInt(), it_name->second.AsString(), catalogue));
-			}
+			// Формируем финальный ответ
+			result = json::Builder{}
+				.StartDict()
+				.Key("request_id").Value(id)
+				.Key("total_time").Value(route_result.total_time)
+				.Key("items").Value(items)
+				.EndDict()
+				.Build()
+				.AsDict();
+		}
+		else {
+			// Если маршрут не найден
+			result = json::Builder{}
+				.StartDict()
+				.Key("request_id").Value(id)
+				.Key("error_message").Value("not found")
+				.EndDict()
+				.Build()
+				.AsDict();
 		}
 
-		return json::Document(stat_info);
+		return result;
 	}
 
 	const json::Dict JsonReader::StatStopInfo(int id, std::string name, const transport_catalogue::TransportCatalogue& catalogue) const {
@@ -558,18 +771,206 @@ namespace json_reader {
 	}
 
 
+	// The tile is given either by "bbox": [min_x, min_y, max_x, max_y] in map coordinates
+	// or by the "z", "x", "y" tile address
+	const json::Dict JsonReader::StatMapTileInfo(int id, const json::Dict& request, const RequestHandler& rh) const {
+		map_renderer::Viewport viewport;
+
+		if (auto it_bbox = request.find("bbox"); it_bbox != request.end()) {
+			const json::Array& bbox = it_bbox->second.AsArray();
+			if (bbox.size() != 4) {
+				throw std::invalid_argument("\"bbox\" must contain exactly 4 elements (min_x, min_y, max_x, max_y)"s);
+			}
+			viewport = { { bbox[0].AsDouble(), bbox[1].AsDouble() }, { bbox[2].AsDouble(), bbox[3].AsDouble() } };
+			if (!(viewport.min.x < viewport.max.x && viewport.min.y < viewport.max.y)) {
+				throw std::invalid_argument("\"bbox\" must have positive width and height"s);
+			}
+		}
+		else {
+			auto it_z = request.find("z");
+			auto it_x = request.find("x");
+			auto it_y = request.find("y");
+			if (it_z == request.end() || it_x == request.end() || it_y == request.end()) {
+				throw std::logic_error("Missing \"bbox\" or \"z\", \"x\", \"y\" fields in \"stat_request\"");
+			}
+			viewport = map_renderer::GetTileViewport(rh.GetRenderSettings(), it_z->second.AsInt(), it_x->second.AsInt(), it_y->second.AsInt());
+		}
+
+		return json::Builder{}.StartDict()
+			.Key("request_id"s).Value(id)
+			.Key("map"s).Value(*rh.GetMapTileSvg(viewport))
+			.EndDict()
+			.Build().AsDict();
+	}
+
+	// Overrides the velocity either for a whole bus ("bus") or for the "from" -> "to" segment of every bus;
+	// "velocity": 0 removes the override. Later requests are routed with the new edge weights
+	const json::Dict JsonReader::StatSetVelocityInfo(int id, const json::Dict& request, graph::LazyTransportRouter<double>& tr) const {
+		auto it_velocity = request.find("velocity");
+		if (it_velocity == request.end()) {
+			throw std::logic_error("Missing \"velocity\" field in \"stat_request\"");
+		}
+
+		graph::VelocityOverride velocity_override;
+		velocity_override.velocity = it_velocity->second.AsDouble();
+
+		auto it_from = request.find("from");
+		auto it_to = request.find("to");
+		if (it_from != request.end() || it_to != request.end()) {
+			if (it_from == request.end() || it_to == request.end()) {
+				throw std::logic_error("A segment velocity override needs both \"from\" and \"to\" fields");
+			}
+			velocity_override.from_stop = it_from->second.AsString();
+			velocity_override.to_stop = it_to->second.AsString();
+		}
+		else if (auto it_bus = request.find("bus"); it_bus != request.end()) {
+			velocity_override.bus = it_bus->second.AsString();
+		}
+		else {
+			throw std::logic_error("Missing \"bus\" or \"from\" and \"to\" fields in \"stat_request\"");
+		}
+
+		const size_t updated_edges = tr.ApplyVelocityOverrides({ velocity_override });
+		return json::Builder{}.StartDict()
+			.Key("request_id"s).Value(id)
+			.Key("updated_edges"s).Value(static_cast<int>(updated_edges))
+			.EndDict()
+			.Build().AsDict();
+	}
+
+	// Switches the weight profile: "bus_wait_time" and/or "bus_velocity" replace the values from "routing_settings"
+	// without rebuilding the routing graph. Velocity overrides stay in effect
+	const json::Dict JsonReader::StatSetRoutingSettingsInfo(int id, const json::Dict& request, graph::LazyTransportRouter<double>& tr) const {
+		std::optional<int> bus_wait_time;
+		std::optional<int> bus_velocity;
+		auto it_bus_wait_time = request.find("bus_wait_time");
+		auto it_bus_velocity = request.find("bus_velocity");
+		if (it_bus_wait_time == request.end() && it_bus_velocity == request.end()) {
+			throw std::logic_error("Missing \"bus_wait_time\" or \"bus_velocity\" field in \"stat_request\"");
+		}
+		if (it_bus_wait_time != request.end()) {
+			bus_wait_time = it_bus_wait_time->second.AsInt();
+			if (!(*bus_wait_time >= 1 && *bus_wait_time <= 1000)) {
+				throw std::invalid_argument("Bus_wait_time must be in range [1, 1000]"s);
+			}
+		}
+		if (it_bus_velocity != request.end()) {
+			bus_velocity = it_bus_velocity->second.AsInt();
+			if (!(*bus_velocity >= 1 && *bus_velocity <= 1000)) {
+				throw std::invalid_argument("Bus_velocity must be in range [1, 1000]"s);
+			}
+		}
+
+		const size_t updated_edges = tr.SetRoutingWeights(bus_wait_time, bus_velocity);
+		return json::Builder{}.StartDict()
+			.Key("request_id"s).Value(id)
+			.Key("updated_edges"s).Value(static_cast<int>(updated_edges))
+			.EndDict()
+			.Build().AsDict();
+	}
+
+	// The route is drawn over the cached network map; a missing route gets the same answer as "Route"
+	const json::Dict JsonReader::StatRouteMapInfo(int id, const std::string& from, const std::string& to,
+		const transport_catalogue::TransportCatalogue& catalogue,
+		const RequestHandler& rh,
+		const graph::LazyTransportRouter<double>& tr) const {
+		auto route_result = tr.FindRoute(from, to);
+		if (!route_result.has_value()) {
+			return json::Builder{}.StartDict()
+				.Key("request_id"s).Value(id)
+				.Key("error_message"s).Value("not found"s)
+				.EndDict()
+				.Build().AsDict();
+		}
+
+		// A bus ride starts at the stop of the preceding wait and ends at the stop of the next wait
+		// (or at the destination for the last ride)
+		std::vector<map_renderer::RouteLeg> legs;
+		const transport_catalogue::StopStation* current_stop = catalogue.GetStopStation(from);
+		for (const auto& item : route_result->items) {
+			if (item.type == graph::TransportRouter<double>::RouteItem::Type::WAIT) {
+				current_stop = &catalogue.GetAllStops()[item.id];
+				if (!legs.empty() && legs.back().to == nullptr) {
+					legs.back().to = current_stop;
+				}
+			}
+			else {
+				legs.push_back({ &catalogue.GetAllRoute()[item.id], current_stop, nullptr, item.span_count });
+			}
+		}
+		if (!legs.empty() && legs.back().to == nullptr) {
+			legs.back().to = catalogue.GetStopStation(to);
+		}
+
+		return json::Builder{}.StartDict()
+			.Key("request_id"s).Value(id)
+			.Key("total_time"s).Value(route_result->total_time)
+			.Key("map"s).Value(rh.GetRouteMapSvg(legs))
+			.EndDict()
+			.Build().AsDict();
+	}
+
 	const json::Dict JsonReader::StatMapInfo(int id, const RequestHandler& rh) const {
 		json::Dict result;
 
-		std::ostringstream s;
-		rh.RenderMap().Render(s);
-
 		result = json::Builder{}.StartDict()
 			.Key("request_id"s).Value(id)
-			.Key("map"s).Value(s.str())
+			.Key("map"s).Value(*rh.GetMapSvg())
 			.EndDict()
 			.Build().AsDict();
 
 		return result;
 	}
+
+	namespace {
+		// Sizes of large structures (the router matrix) do not fit into an int node
+		json::Node BytesNode(size_t bytes) {
+			if (bytes <= static_cast<size_t>(std::numeric_limits<int>::max())) {
+				return static_cast<int>(bytes);
+			}
+			return static_cast<double>(bytes);
+		}
+
+		json::Dict ReportToDict(const memory_stats::Report& report) {
+			json::Dict result;
+			for (const auto& [name, bytes] : report) {
+				result[name] = BytesNode(bytes);
+			}
+			result["total"s] = BytesNode(memory_stats::Total(report));
+			return result;
+		}
+	}
+
+	json::Dict JsonReader::MemoryReport(const transport_catalogue::TransportCatalogue& catalogue, const graph::LazyTransportRouter<double>& tr) const {
+		const memory_stats::Report catalogue_report = catalogue.MemoryStats();
+
+		// The reader keeps both the parsed document and a copy of its root dictionary
+		memory_stats::Report json_report = input_json_.MemoryStats();
+		json_report["root_copy"s] = memory_stats::Total(json::MemoryStats(json_));
+
+		size_t total = memory_stats::Total(catalogue_report) + memory_stats::Total(json_report);
+
+		json::Dict result;
+		result["catalogue"s] = ReportToDict(catalogue_report);
+		result["json"s] = ReportToDict(json_report);
+
+		const graph::TransportRouter<double>* router = tr.GetIfReady();
+		result["router_built"s] = router != nullptr;
+		if (router != nullptr) {
+			const graph::TransportRouter<double>::MemoryReport router_report = router->MemoryStats();
+			total += memory_stats::Total(router_report.graph) + memory_stats::Total(router_report.router);
+			result["graph"s] = ReportToDict(router_report.graph);
+			result["router"s] = ReportToDict(router_report.router);
+			result["router_engine"s] = std::string(graph::GetRouterEngineName(router->GetEngine()));
+		}
+
+		result["total"s] = BytesNode(total);
+		return result;
+	}
+
+	const json::Dict JsonReader::StatMemoryInfo(int id, const transport_catalogue::TransportCatalogue& catalogue, const graph::LazyTransportRouter<double>& tr) const {
+		json::Dict result = MemoryReport(catalogue, tr);
+		result["request_id"s] = id;
+		return result;
+	}
 }
\ No newline at end of file
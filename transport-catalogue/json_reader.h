@@ -4,6 +4,9 @@
 #include "transport_router.h"
 #include "map_renderer.h"
 #include "json_builder.h"
+#include "parallel.h"
+#include "profile.h"
+#include <optional>
 #include <sstream>
 
 // Костыль
@@ -21,11 +24,13 @@ namespace json_reader {
 	class JsonReader {
 	public:
 		JsonReader(std::istream& input)
-			: input_json_(json::Load(input))
+			: input_json_(LoadInput(input))
 			, json_(input_json_.GetRoot().AsDict())
 		{
-			if (json_.size() != 4) {
-				throw std::logic_error("JsonReader: The dictionary has not 4 elements");
+			// "stat_requests" may be absent when the document only describes the base (server mode)
+			const size_t expected_size = json_.count(stat_key) ? 4 : 3;
+			if (json_.size() != expected_size) {
+				throw std::logic_error("JsonReader: The dictionary has not " + std::to_string(expected_size) + " elements");
 			}
 
 			if (json_.find(base_key) == json_.end()) {
@@ -40,17 +45,27 @@ namespace json_reader {
 				throw std::logic_error("JsonReader: The dictionary is missing a key\"" + routing_key + "\"");
 			}
 
-			if (json_.find(stat_key) == json_.end()) {
-				throw std::logic_error("JsonReader: The dictionary is missing a key\"" + stat_key + "\"");
-			}
 		}
 
 		transport_catalogue::TransportCatalogue ApplyBaseRequests() const;
 		map_renderer::RenderSettings ApplyRenderSettings() const;
 		graph::RouteSetting ApplyRoutingSetting() const;
-		const json::Document StatInfo(const transport_catalogue::TransportCatalogue& catalogue, const RequestHandler& rh, const graph::TransportRouter<double>& tr) const;
+		// thread_count > 1 answers the requests concurrently; responses keep the request order.
+		// Requests that change the router ("SetVelocity", "SetRoutingSettings") are barriers: the requests before them are answered first,
+		// then the change is applied alone, so the answers do not depend on thread_count
+		const json::Document StatInfo(const transport_catalogue::TransportCatalogue& catalogue, const RequestHandler& rh, graph::LazyTransportRouter<double>& tr,
+			size_t thread_count = 1) const;
+
+		// Answers a single stat request; throws std::logic_error if the request type is unknown
+		json::Node AnswerStatRequest(const json::Dict& request, const transport_catalogue::TransportCatalogue& catalogue,
+			const RequestHandler& rh, graph::LazyTransportRouter<double>& tr) const;
+
+		// Estimated heap usage of the catalogue, the graph and router (only if already built) and the input JSON
+		json::Dict MemoryReport(const transport_catalogue::TransportCatalogue& catalogue, const graph::LazyTransportRouter<double>& tr) const;
 
 	private:
+		static json::Document LoadInput(std::istream& input);
+
 		void ProcessStopRequests(const json::Array& array, transport_catalogue::TransportCatalogue& tc) const;
 		void ProcessBusRequests(const json::Array& array, transport_catalogue::TransportCatalogue& tc) const;
 		void ApplyStopInfo(const json::Dict& dict, transport_catalogue::TransportCatalogue& tc) const;
@@ -62,11 +77,23 @@ namespace json_reader {
 		void ApplyStopLabel(const json::Dict& dict, map_renderer::RenderSettings& rs) const;
 		void ApplyUnderlayer(const json::Dict& dict, map_renderer::RenderSettings& rs) const;
 		void ApplyColorPalette(const json::Dict& dict, map_renderer::RenderSettings& rs) const;
+		void ApplyPolylineSimplification(const json::Dict& dict, map_renderer::RenderSettings& rs) const;
+		void ApplyOutputFormat(const json::Dict& dict, map_renderer::RenderSettings& rs) const;
 		const svg::Color ParseColorFromJson(const json::Node& clr) const;
 
+		std::optional<json::Node> StatRequestInfo(const json::Dict& request, const transport_catalogue::TransportCatalogue& catalogue,
+			const RequestHandler& rh, const graph::LazyTransportRouter<double>& tr) const;
+		json::Node MutatingRequestInfo(const json::Dict& request, graph::LazyTransportRouter<double>& tr) const;
+		const json::Dict StatRouteInfo(int id, const std::string& from, const std::string& to, const graph::LazyTransportRouter<double>& tr) const;
 		const json::Dict StatStopInfo(int id, std::string name, const transport_catalogue::TransportCatalogue& catalogue) const;
 		const json::Dict StatBusInfo(int id, std::string name, const transport_catalogue::TransportCatalogue& catalogue) const;
 		const json::Dict StatMapInfo(int id, const RequestHandler& rh) const;
+		const json::Dict StatMemoryInfo(int id, const transport_catalogue::TransportCatalogue& catalogue, const graph::LazyTransportRouter<double>& tr) const;
+		const json::Dict StatMapTileInfo(int id, const json::Dict& request, const RequestHandler& rh) const;
+		const json::Dict StatSetVelocityInfo(int id, const json::Dict& request, graph::LazyTransportRouter<double>& tr) const;
+		const json::Dict StatSetRoutingSettingsInfo(int id, const json::Dict& request, graph::LazyTransportRouter<double>& tr) const;
+		const json::Dict StatRouteMapInfo(int id, const std::string& from, const std::string& to, const transport_catalogue::TransportCatalogue& catalogue,
+			const RequestHandler& rh, const graph::LazyTransportRouter<double>& tr) const;
 
 	private:
 		const json::Document input_json_;
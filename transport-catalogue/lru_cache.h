@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cache {
+
+    /*
+     * Потокобезопасный кеш ограниченного размера с вытеснением давно не использованных записей (LRU).
+     * Значения возвращаются копией, поэтому для крупных значений удобно хранить std::shared_ptr<const T>
+     */
+    template <typename Key, typename Value, typename Hash = std::hash<Key>>
+    class LruCache {
+    public:
+        struct Stats {
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t size = 0;
+            size_t capacity = 0;
+        };
+
+        // Кеш нулевой ёмкости ничего не хранит
+        explicit LruCache(size_t capacity)
+            : capacity_(capacity) {
+        }
+
+        std::optional<Value> Get(const Key& key) {
+            std::lock_guard guard(mutex_);
+            auto it = index_.find(key);
+            if (it == index_.end()) {
+                ++misses_;
+                return std::nullopt;
+            }
+            ++hits_;
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return it->second->second;
+        }
+
+        void Put(const Key& key, Value value) {
+            std::lock_guard guard(mutex_);
+            if (capacity_ == 0) {
+                return;
+            }
+
+            if (auto it = index_.find(key); it != index_.end()) {
+                it->second->second = std::move(value);
+                entries_.splice(entries_.begin(), entries_, it->second);
+                return;
+            }
+
+            if (entries_.size() == capacity_) {
+                index_.erase(entries_.back().first);
+                entries_.pop_back();
+            }
+            entries_.emplace_front(key, std::move(value));
+            index_.emplace(key, entries_.begin());
+        }
+
+        size_t GetCapacity() const {
+            return capacity_;
+        }
+
+        void Clear() {
+            std::lock_guard guard(mutex_);
+            entries_.clear();
+            index_.clear();
+        }
+
+        Stats GetStats() const {
+            std::lock_guard guard(mutex_);
+            return { hits_, misses_, entries_.size(), capacity_ };
+        }
+
+    private:
+        using Entries = std::list<std::pair<Key, Value>>;
+
+        const size_t capacity_;
+        mutable std::mutex mutex_;
+        Entries entries_;
+        std::unordered_map<Key, typename Entries::iterator, Hash> index_;
+        size_t hits_ = 0;
+        size_t misses_ = 0;
+    };
+
+    /*
+     * Потокобезопасный LRU-кеш, все записи которого выделены при создании.
+     * Значения не копируются целиком: Read передаёт читателю ссылку на значение в кеше,
+     * Write даёт писателю заполнить слот, а слот вытесненной записи переиспользуется вместе
+     * с памятью своего значения. Поэтому после прогрева кеш не выделяет память
+     */
+    template <typename Key, typename Value, typename Hash = std::hash<Key>>
+    class FixedLruCache {
+    public:
+        struct Stats {
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t size = 0;
+            size_t capacity = 0;
+        };
+
+        // Кеш нулевой ёмкости ничего не хранит
+        explicit FixedLruCache(size_t capacity)
+            : slots_(capacity)
+            , index_(capacity == 0 ? 0 : GetIndexSize(capacity), NONE) {
+        }
+
+        // Вызывает reader(const Value&) для записи ключа; возвращает false, если записи нет
+        template <typename Reader>
+        bool Read(const Key& key, Reader&& reader) {
+            std::lock_guard guard(mutex_);
+            const size_t position = FindPosition(key);
+            if (position == NONE || index_[position] == NONE) {
+                ++misses_;
+                return false;
+            }
+            ++hits_;
+            const size_t slot = index_[position];
+            MoveToFront(slot);
+            reader(static_cast<const Value&>(slots_[slot].value));
+            return true;
+        }
+
+        // Вызывает writer(Value&) для слота ключа; при нехватке места занимает слот самой старой записи
+        template <typename Writer>
+        void Write(const Key& key, Writer&& writer) {
+            std::lock_guard guard(mutex_);
+            if (slots_.empty()) {
+                return;
+            }
+
+            size_t position = FindPosition(key);
+            size_t slot = index_[position];
+            if (slot == NONE) {
+                if (size_ < slots_.size()) {
+                    slot = size_++;
+                }
+                else {
+                    slot = tail_;
+                    Unlink(slot);
+                    EraseFromIndex(slots_[slot].key);
+                    position = FindPosition(key);
+                }
+                slots_[slot].key = key;
+                index_[position] = slot;
+                PushFront(slot);
+            }
+            else {
+                MoveToFront(slot);
+            }
+            writer(slots_[slot].value);
+        }
+
+        size_t GetCapacity() const {
+            return slots_.size();
+        }
+
+        // Память значений остаётся в слотах и переиспользуется следующими записями
+        void Clear() {
+            std::lock_guard guard(mutex_);
+            std::fill(index_.begin(), index_.end(), NONE);
+            size_ = 0;
+            head_ = NONE;
+            tail_ = NONE;
+        }
+
+        Stats GetStats() const {
+            std::lock_guard guard(mutex_);
+            return { hits_, misses_, size_, slots_.size() };
+        }
+
+    private:
+        static constexpr size_t NONE = std::numeric_limits<size_t>::max();
+
+        struct Slot {
+            Key key{};
+            Value value{};
+            size_t prev = NONE;
+            size_t next = NONE;
+        };
+
+        // Таблица с открытой адресацией заполнена не больше чем наполовину
+        static size_t GetIndexSize(size_t capacity) {
+            size_t size = 1;
+            while (size < capacity * 2) {
+                size *= 2;
+            }
+            return size;
+        }
+
+        // Позиция ключа в таблице или первая свободная позиция его цепочки проб
+        size_t FindPosition(const Key& key) const {
+            if (index_.empty()) {
+                return NONE;
+            }
+            const size_t mask = index_.size() - 1;
+            size_t position = hash_(key) & mask;
+            while (index_[position] != NONE && !(slots_[index_[position]].key == key)) {
+                position = (position + 1) & mask;
+            }
+            return position;
+        }
+
+        // Удаление со сдвигом следующих записей цепочки, чтобы не оставлять пометок об удалении
+        void EraseFromIndex(const Key& key) {
+            const size_t mask = index_.size() - 1;
+            size_t hole = FindPosition(key);
+            size_t position = hole;
+            while (true) {
+                position = (position + 1) & mask;
+                if (index_[position] == NONE) {
+                    break;
+                }
+                const size_t home = hash_(slots_[index_[position]].key) & mask;
+                // Запись можно перенести в дыру, если её исходная позиция не лежит между дырой и ней
+                if (((position - home) & mask) >= ((position - hole) & mask)) {
+                    index_[hole] = index_[position];
+                    hole = position;
+                }
+            }
+            index_[hole] = NONE;
+        }
+
+        void Unlink(size_t slot) {
+            Slot& item = slots_[slot];
+            (item.prev == NONE ? head_ : slots_[item.prev].next) = item.next;
+            (item.next == NONE ? tail_ : slots_[item.next].prev) = item.prev;
+            item.prev = NONE;
+            item.next = NONE;
+        }
+
+        void PushFront(size_t slot) {
+            slots_[slot].prev = NONE;
+            slots_[slot].next = head_;
+            (head_ == NONE ? tail_ : slots_[head_].prev) = slot;
+            head_ = slot;
+        }
+
+        void MoveToFront(size_t slot) {
+            if (slot != head_) {
+                Unlink(slot);
+                PushFront(slot);
+            }
+        }
+
+        mutable std::mutex mutex_;
+        std::vector<Slot> slots_;
+        std::vector<size_t> index_;
+        Hash hash_;
+        size_t size_ = 0;
+        size_t head_ = NONE;
+        size_t tail_ = NONE;
+        size_t hits_ = 0;
+        size_t misses_ = 0;
+    };
+
+}  // namespace cache
@@ -1,19 +1,199 @@
 #include "json_reader.h"
 #include "map_renderer.h"
+#include "parallel.h"
+#include "profile.h"
+#include "query_server.h"
 #include "request_handler.h"
 
 #include "transport_router.h"
 
-int main() {
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+
+using namespace std::literals;
+
+namespace {
+    struct ProgramOptions {
+        // Число потоков для ответов на stat_requests и для отрисовки карты (1 — последовательно)
+        size_t thread_count = 1;
+
+        // Режим сервера: база загружается один раз, далее stat-запросы читаются построчно
+        bool serve = false;
+        // Файл с базой для режима сервера (по умолчанию — первый JSON-документ из stdin)
+        std::string base_path;
+        // Unix domain socket для режима сервера (по умолчанию запросы читаются из stdin)
+        std::string socket_path;
+
+        // Когда строить маршрутизатор; по умолчанию в пакетном режиме — при первом запросе Route,
+        // в режиме сервера — в фоне, пока обслуживаются остальные запросы
+        std::optional<graph::RouterBuildMode> router_mode;
+
+        // Сбор статистики по фазам: отчёт в stderr или в файл profile_path
+        bool profile = false;
+        std::string profile_path;
+        // Подсчёт выделений памяти по этапам, отчёт вместе со статистикой фаз
+        bool profile_allocations = false;
+
+        // Оценка памяти справочника, графа, маршрутизатора и входного JSON в stderr по окончании работы
+        bool memory_stats = false;
+    };
+
+    bool StartsWith(std::string_view arg, std::string_view prefix) {
+        return arg.substr(0, prefix.size()) == prefix;
+    }
+
+    // Поддерживаемые флаги:
+    //   --threads=N    ответы на запросы, отрисовка карты и построение графа в N потоках (--threads без значения — по числу ядер)
+    //   --serve        режим сервера, один запрос на строку (NDJSON), один ответ на строку
+    //   --base=FILE    база для режима сервера
+    //   --socket=PATH  принимать запросы на Unix domain socket вместо stdin, до SIGINT или SIGTERM
+    //   --router=MODE  построение маршрутизатора: eager, lazy или background
+    //   --profile[=FILE]  отчёт о времени фаз и счётчиках в stderr или в FILE (также переменная TC_PROFILE)
+    //   --memory-stats  оценка памяти основных структур данных в stderr
+    //   --profile-allocations  добавить в отчёт выделения памяти по этапам (также переменная TC_PROFILE_ALLOCATIONS)
+    ProgramOptions ParseOptions(int argc, char* argv[]) {
+        ProgramOptions options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view arg = argv[i];
+            if (arg == "--threads"sv) {
+                options.thread_count = parallel::DefaultThreadCount();
+            }
+            else if (StartsWith(arg, "--threads="sv)) {
+                const int thread_count = std::atoi(argv[i] + "--threads="sv.size());
+                if (thread_count < 1) {
+                    throw std::invalid_argument("Thread count must be positive"s);
+                }
+                options.thread_count = static_cast<size_t>(thread_count);
+            }
+            else if (arg == "--serve"sv) {
+                options.serve = true;
+            }
+            else if (StartsWith(arg, "--base="sv)) {
+                options.base_path = arg.substr("--base="sv.size());
+            }
+            else if (StartsWith(arg, "--socket="sv)) {
+                options.socket_path = arg.substr("--socket="sv.size());
+            }
+            else if (StartsWith(arg, "--router="sv)) {
+                const std::string_view mode = arg.substr("--router="sv.size());
+                if (mode == "eager"sv) {
+                    options.router_mode = graph::RouterBuildMode::EAGER;
+                }
+                else if (mode == "lazy"sv) {
+                    options.router_mode = graph::RouterBuildMode::LAZY;
+                }
+                else if (mode == "background"sv) {
+                    options.router_mode = graph::RouterBuildMode::BACKGROUND;
+                }
+                else {
+                    throw std::invalid_argument("Unknown router build mode: "s + std::string(mode));
+                }
+            }
+            else if (arg == "--profile"sv) {
+                options.profile = true;
+            }
+            else if (arg == "--memory-stats"sv) {
+                options.memory_stats = true;
+            }
+            else if (arg == "--profile-allocations"sv) {
+                options.profile_allocations = true;
+            }
+            else if (StartsWith(arg, "--profile="sv)) {
+                options.profile = true;
+                options.profile_path = arg.substr("--profile="sv.size());
+            }
+            else {
+                throw std::invalid_argument("Unknown option: "s + std::string(arg));
+            }
+        }
+        if (!options.serve && (!options.base_path.empty() || !options.socket_path.empty())) {
+            throw std::invalid_argument("--base and --socket are only valid with --serve"s);
+        }
+        return options;
+    }
+
+    void PrintMemoryStats(const json_reader::JsonReader& json, const transport_catalogue::TransportCatalogue& tc,
+        const graph::LazyTransportRouter<double>& tr) {
+        json::Print(json::Document(json.MemoryReport(tc, tr)), std::cerr);
+        std::cerr << std::endl;
+    }
+
+    // Строит справочник, обработчик карты и маршрутизатор один раз и обслуживает запросы до конца ввода
+    void Serve(const ProgramOptions& options) {
+        std::ifstream base_file;
+        if (!options.base_path.empty()) {
+            base_file.open(options.base_path);
+            if (!base_file) {
+                throw std::runtime_error("Failed to open base file "s + options.base_path);
+            }
+        }
+
+        json_reader::JsonReader json(options.base_path.empty() ? std::cin : base_file);
+
+        const transport_catalogue::TransportCatalogue tc = json.ApplyBaseRequests();
+        const map_renderer::RenderSettings render_settings = json.ApplyRenderSettings();
+        const graph::RouteSetting route_setting = json.ApplyRoutingSetting();
+        RequestHandler rh(tc, render_settings, options.thread_count);
+        graph::LazyTransportRouter<double> tr(tc, route_setting, options.router_mode.value_or(graph::RouterBuildMode::BACKGROUND),
+            options.thread_count);
+
+        query_server::QueryServer server(json, tc, rh, tr);
+        if (options.socket_path.empty()) {
+            server.Serve(std::cin, std::cout);
+        }
+        else {
+            server.ServeUnixSocket(options.socket_path);
+        }
+
+        if (options.memory_stats) {
+            PrintMemoryStats(json, tc, tr);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const ProgramOptions options = ParseOptions(argc, argv);
+    profile::EnableFromEnvironment();
+    if (options.profile) {
+        profile::Enable(options.profile_path);
+    }
+    profile::EnableAllocationTrackingFromEnvironment();
+    if (options.profile_allocations) {
+        profile::EnableAllocationTracking();
+    }
+
+    if (options.serve) {
+        Serve(options);
+        profile::WriteReport();
+        return 0;
+    }
+
     json_reader::JsonReader json(std::cin);
 
     const transport_catalogue::TransportCatalogue tc = json.ApplyBaseRequests();
     const map_renderer::RenderSettings render_settings = json.ApplyRenderSettings();
     const graph::RouteSetting route_setting = json.ApplyRoutingSetting();
-    RequestHandler rh(tc, render_settings);
-    
+    RequestHandler rh(tc, render_settings, options.thread_count);
+
     //graph::TransportGraph<double> tg(tc, route_setting);
-    graph::TransportRouter<double> tr(tc, route_setting);
+    graph::LazyTransportRouter<double> tr(tc, route_setting, options.router_mode.value_or(graph::RouterBuildMode::LAZY),
+        options.thread_count);
 
-    json::Print(json.StatInfo(tc, rh, tr), std::cout);
+    const json::Document answers = json.StatInfo(tc, rh, tr, options.thread_count);
+    {
+        profile::ScopedPhase phase("json_print", profile::AllocationTag::PRINT);
+        // Вывод идёт через счётчик байтов только при включённой статистике
+        profile::CountingStreamBuf counting_buf(std::cout.rdbuf());
+        std::ostream counting_out(&counting_buf);
+        json::Print(answers, profile::IsEnabled() ? counting_out : std::cout);
+        counting_out.flush();
+        profile::AddCounter("output.bytes", counting_buf.GetCount());
+    }
+    if (options.memory_stats) {
+        PrintMemoryStats(json, tc, tr);
+    }
+    profile::WriteReport();
 }
\ No newline at end of file
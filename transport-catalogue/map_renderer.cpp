@@ -1,168 +1,617 @@
 #include "map_renderer.h"
+#include "parallel.h"
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
 
 namespace map_renderer {
-	svg::Document RenderMap::RenderAllLayers(const transport_catalogue::TransportCatalogue& tc) {
-		svg::Document render_map;
-		render_map.Merge(RenderBusRoutes());
-		render_map.Merge(RenderBusLabels());
-		render_map.Merge(RenderStopSymbols(tc));
-		render_map.Merge(RenderStopLabels(tc));
-		return render_map;
+	using namespace std::literals;
+
+	Viewport GetTileViewport(const RenderSettings& rs, int zoom, int x, int y) {
+		if (zoom < 0 || zoom > 30) {
+			throw std::out_of_range("Tile zoom must be in range [0, 30]"s);
+		}
+		const long long tiles = 1LL << zoom;
+		if (x < 0 || y < 0 || x >= tiles || y >= tiles) {
+			throw std::out_of_range("Tile x and y must be in range [0, 2^zoom)"s);
+		}
+
+		const double tile_width = rs.width_ / static_cast<double>(tiles);
+		const double tile_height = rs.height_ / static_cast<double>(tiles);
+		return { { x * tile_width, y * tile_height }, { (x + 1) * tile_width, (y + 1) * tile_height } };
 	}
 
-	svg::Document RenderMap::RenderBusRoutes() {
-		svg::Document render_map;
+	namespace {
+		// Оценка границ подписи: ширина символа не больше 0.6 от размера шрифта,
+		// а для многобайтовых символов UTF-8 оценка по байтам только завышает ширину
+		Viewport EstimateTextBounds(svg::Point position, std::string_view text, const svg::TextStyle& style) {
+			const double size = static_cast<double>(style.font_size);
+			const double stroke = style.path.stroke_width.value_or(0.0);
+			const double x = position.x + style.offset.x;
+			const double y = position.y + style.offset.y;
+			return { { x - stroke, y - size - stroke },
+				{ x + size * 0.6 * static_cast<double>(text.size()) + stroke, y + size * 0.3 + stroke } };
+		}
 
-		size_t color_palette_index = 0;
-		for (const auto& bus : buses_) {
-			if (bus.route.empty()) {
-				continue;
+		Viewport PointBounds(svg::Point point, double radius) {
+			return { { point.x - radius, point.y - radius }, { point.x + radius, point.y + radius } };
+		}
+
+		double SquaredDistanceToSegment(svg::Point point, svg::Point from, svg::Point to) {
+			const double dx = to.x - from.x;
+			const double dy = to.y - from.y;
+			const double length = dx * dx + dy * dy;
+			double t = 0.0;
+			if (length > 0.0) {
+				t = std::clamp(((point.x - from.x) * dx + (point.y - from.y) * dy) / length, 0.0, 1.0);
 			}
+			const double px = from.x + t * dx - point.x;
+			const double py = from.y + t * dy - point.y;
+			return px * px + py * py;
+		}
 
-			svg::Polyline p;
-			for (const auto& stop : bus.route) {
-				p.AddPoint(projector_(stop->coordinates));
+		// Буферы упрощения переиспользуются между вызовами, чтобы не выделять память на каждый маршрут
+		struct SimplificationBuffers {
+			std::vector<svg::Point> points;
+			std::vector<bool> keep;
+			std::vector<std::pair<size_t, size_t>> ranges;
+		};
+
+		// Алгоритм Дугласа-Пекера без рекурсии: оставляет точки, удалённые от упрощённой линии больше чем на tolerance
+		void SimplifyDouglasPeucker(SimplificationBuffers& buffers, double tolerance) {
+			std::vector<svg::Point>& points = buffers.points;
+			if (points.size() < 3) {
+				return;
 			}
 
-			render_map.Add(p.SetStrokeColor(rs_.color_palette_[color_palette_index++])
-				.SetFillColor(svg::NoneColor)
-				.SetStrokeWidth(rs_.line_width_)
-				.SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-				.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND));
-			color_palette_index %= rs_.color_palette_.size();
+			const double squared_tolerance = tolerance * tolerance;
+			buffers.keep.assign(points.size(), false);
+			buffers.keep.front() = true;
+			buffers.keep.back() = true;
+
+			buffers.ranges.clear();
+			buffers.ranges.emplace_back(0, points.size() - 1);
+			while (!buffers.ranges.empty()) {
+				const auto [first, last] = buffers.ranges.back();
+				buffers.ranges.pop_back();
+
+				double max_distance = 0.0;
+				size_t farthest = first;
+				for (size_t i = first + 1; i < last; ++i) {
+					const double distance = SquaredDistanceToSegment(points[i], points[first], points[last]);
+					if (distance > max_distance) {
+						max_distance = distance;
+						farthest = i;
+					}
+				}
+
+				if (max_distance > squared_tolerance) {
+					buffers.keep[farthest] = true;
+					buffers.ranges.emplace_back(first, farthest);
+					buffers.ranges.emplace_back(farthest, last);
+				}
+			}
+
+			size_t kept = 0;
+			for (size_t i = 0; i < points.size(); ++i) {
+				if (buffers.keep[i]) {
+					points[kept++] = points[i];
+				}
+			}
+			points.resize(kept);
+		}
+
+		// Привязывает точки к сетке с шагом cell и убирает совпавшие соседние точки
+		void SnapToPixelGrid(SimplificationBuffers& buffers, double cell) {
+			std::vector<svg::Point>& points = buffers.points;
+			size_t kept = 0;
+			for (const svg::Point& point : points) {
+				const svg::Point snapped(std::round(point.x / cell) * cell, std::round(point.y / cell) * cell);
+				if (kept == 0 || snapped.x != points[kept - 1].x || snapped.y != points[kept - 1].y) {
+					points[kept++] = snapped;
+				}
+			}
+			points.resize(kept);
+		}
+
+		Viewport SegmentBounds(svg::Point from, svg::Point to, double radius) {
+			return { { std::min(from.x, to.x) - radius, std::min(from.y, to.y) - radius },
+				{ std::max(from.x, to.x) + radius, std::max(from.y, to.y) + radius } };
+		}
+	}
+
+	void RenderMap::RenderAllLayers(std::ostream& out, size_t thread_count) const {
+		svg::StreamWriter writer(out, GetWriterOptions());
+		writer.BeginDocument();
+		RenderStyleSheet(writer);
+
+		const size_t element_count = GetElementCount();
+		if (thread_count <= 1) {
+			RenderElements(writer, 0, element_count);
+		}
+		else {
+			// Частей больше, чем потоков, чтобы тяжёлые участки (длинные маршруты) не задерживали остальные
+			const size_t chunk_count = std::min(element_count, thread_count * 4);
+			std::vector<std::string> chunks(chunk_count);
+			parallel::ForEachIndex(chunk_count, thread_count, [&](size_t chunk) {
+				std::ostringstream chunk_out;
+				svg::StreamWriter chunk_writer(chunk_out, GetWriterOptions());
+				RenderElements(chunk_writer, chunk * element_count / chunk_count, (chunk + 1) * element_count / chunk_count);
+				chunks[chunk] = chunk_out.str();
+			});
+
+			for (const std::string& chunk : chunks) {
+				out << chunk;
+			}
 		}
 
-		return render_map;
+		writer.EndDocument();
 	}
 
-	svg::Document RenderMap::RenderBusLabels() {
-		svg::Document render_map;
+	void RenderMap::RenderElements(svg::StreamWriter& writer, size_t first, size_t last) const {
+		const size_t bus_count = buses_.size();
+		const size_t stop_count = stops_.size();
 
-		size_t color_palette_index = 0;
-		for (const auto& bus : buses_) {
-			if (bus.route.empty()) {
+		// Границы слоёв в общей нумерации элементов
+		const size_t bus_labels_begin = bus_count;
+		const size_t stop_symbols_begin = 2 * bus_count;
+		const size_t stop_labels_begin = 2 * bus_count + stop_count;
+
+		for (size_t element = first; element < std::min(last, bus_labels_begin); ++element) {
+			RenderBusRoute(writer, element);
+		}
+		for (size_t element = std::max(first, bus_labels_begin); element < std::min(last, stop_symbols_begin); ++element) {
+			RenderBusLabel(writer, element - bus_labels_begin);
+		}
+		for (size_t element = std::max(first, stop_symbols_begin); element < std::min(last, stop_labels_begin); ++element) {
+			RenderStopSymbol(writer, element - stop_symbols_begin);
+		}
+		for (size_t element = std::max(first, stop_labels_begin); element < last; ++element) {
+			RenderStopLabel(writer, element - stop_labels_begin);
+		}
+	}
+
+	void RenderMap::RenderViewport(std::ostream& out, const Viewport& viewport) const {
+		const SpatialIndex& index = GetSpatialIndex();
+
+		std::vector<size_t> bus_routes;
+		std::vector<size_t> bus_labels;
+		std::vector<size_t> stops;
+
+		if (index.area.Intersects(viewport)) {
+			const double cell_width = (index.area.max.x - index.area.min.x) / static_cast<double>(index.columns);
+			const double cell_height = (index.area.max.y - index.area.min.y) / static_cast<double>(index.rows);
+			auto to_cell = [](double value, double origin, double cell_size, size_t count) {
+				const double cell = cell_size > 0 ? std::floor((value - origin) / cell_size) : 0.0;
+				return static_cast<size_t>(std::clamp(cell, 0.0, static_cast<double>(count - 1)));
+			};
+
+			const size_t first_column = to_cell(viewport.min.x, index.area.min.x, cell_width, index.columns);
+			const size_t last_column = to_cell(viewport.max.x, index.area.min.x, cell_width, index.columns);
+			const size_t first_row = to_cell(viewport.min.y, index.area.min.y, cell_height, index.rows);
+			const size_t last_row = to_cell(viewport.max.y, index.area.min.y, cell_height, index.rows);
+
+			for (size_t row = first_row; row <= last_row; ++row) {
+				for (size_t column = first_column; column <= last_column; ++column) {
+					const SpatialIndex::Cell& cell = index.cells[row * index.columns + column];
+					bus_routes.insert(bus_routes.end(), cell.bus_routes.begin(), cell.bus_routes.end());
+					bus_labels.insert(bus_labels.end(), cell.bus_labels.begin(), cell.bus_labels.end());
+					stops.insert(stops.end(), cell.stops.begin(), cell.stops.end());
+				}
+			}
+		}
+
+		// Элементы выводятся в том же порядке, что и на полной карте
+		for (std::vector<size_t>* indices : { &bus_routes, &bus_labels, &stops }) {
+			std::sort(indices->begin(), indices->end());
+			indices->erase(std::unique(indices->begin(), indices->end()), indices->end());
+		}
+
+		svg::StreamWriter writer(out, GetWriterOptions());
+		writer.BeginDocument(viewport.min, viewport.max.x - viewport.min.x, viewport.max.y - viewport.min.y);
+		RenderStyleSheet(writer);
+		for (size_t bus_index : bus_routes) {
+			if (BusRouteIntersects(bus_index, viewport)) {
+				RenderBusRoute(writer, bus_index);
+			}
+		}
+		for (size_t bus_index : bus_labels) {
+			if (index.bus_label_bounds[bus_index].Intersects(viewport)) {
+				RenderBusLabel(writer, bus_index);
+			}
+		}
+		for (size_t stop_index : stops) {
+			if (index.stop_symbol_bounds[stop_index].Intersects(viewport)) {
+				RenderStopSymbol(writer, stop_index);
+			}
+		}
+		for (size_t stop_index : stops) {
+			if (index.stop_label_bounds[stop_index].Intersects(viewport)) {
+				RenderStopLabel(writer, stop_index);
+			}
+		}
+		writer.EndDocument();
+	}
+
+	void RenderMap::RenderStyleSheet(svg::StreamWriter& writer) const {
+		if (!rs_.css_styles_) {
+			return;
+		}
+
+		writer.BeginStyleSheet();
+		for (const svg::PathStyle& style : styles_.bus_routes) {
+			writer.WriteStyleRule(style);
+		}
+		writer.WriteStyleRule(styles_.bus_label_underlayer);
+		for (const svg::TextStyle& style : styles_.bus_labels) {
+			writer.WriteStyleRule(style);
+		}
+		writer.WriteStyleRule(styles_.stop_symbol);
+		writer.WriteStyleRule(styles_.stop_label_underlayer);
+		writer.WriteStyleRule(styles_.stop_label);
+		writer.EndStyleSheet();
+	}
+
+	void RenderMap::RenderRouteOverlay(std::ostream& out, const std::vector<RouteLeg>& legs) const {
+		svg::StreamWriter writer(out, GetWriterOptions());
+
+		// Точки каждого участка; участок ищется в маршруте автобуса по остановкам концов и числу перегонов
+		std::vector<std::vector<svg::Point>> leg_points(legs.size());
+		for (size_t leg_index = 0; leg_index < legs.size(); ++leg_index) {
+			const RouteLeg& leg = legs[leg_index];
+			const size_t span = static_cast<size_t>(leg.span_count);
+			if (leg.bus == nullptr || span == 0 || span >= leg.bus->route.size()) {
 				continue;
 			}
 
-			svg::Text substrate_properties;
-			substrate_properties
-				.SetOffset(svg::Point(rs_.bus_label_offset_[0], rs_.bus_label_offset_[1]))
-				.SetFontSize(rs_.bus_label_font_size_)
-				.SetFontFamily("Verdana")
-				.SetFontWeight("bold");
-
-			svg::Text general_properties = substrate_properties;
-			general_properties
-				.SetFillColor(rs_.underlayer_color_)
-				.SetStrokeColor(rs_.underlayer_color_)
-				.SetStrokeWidth(rs_.underlayer_width_)
-				.SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-				.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-
-			if (bus.is_roundtrip) {
-				general_properties.SetPosition(projector_(bus.route.back()->coordinates))
-					.SetData(bus.name);
-
-				substrate_properties.SetPosition(projector_(bus.route.back()->coordinates))
-					.SetData(bus.name)
-					.SetFillColor(rs_.color_palette_[color_palette_index++]);
-			}
-			else {
-				general_properties.SetPosition(projector_(bus.route.back()->coordinates))
-					.SetData(bus.name);
-				substrate_properties.SetPosition(projector_(bus.route.back()->coordinates))
-					.SetData(bus.name)
-					.SetFillColor(rs_.color_palette_[color_palette_index]);
-
-				if ((bus.route[bus.route.size() / 2]->name != bus.route.back()->name)) {
-					render_map.Add(general_properties);
-					render_map.Add(substrate_properties);
-
-					svg::Point g(projector_(bus.route[bus.route.size() / 2]->coordinates));
-					general_properties.SetPosition(g)
-						.SetData(bus.name);
-					substrate_properties.SetPosition(g)
-						.SetData(bus.name)
-						.SetFillColor(rs_.color_palette_[color_palette_index]);
+			const auto& route = leg.bus->route;
+
+			std::vector<svg::Point>& points = leg_points[leg_index];
+			for (size_t first = 0; first + span < route.size() && points.empty(); ++first) {
+				if (route[first] == leg.from && route[first + span] == leg.to) {
+					for (size_t i = first; i <= first + span; ++i) {
+						points.push_back(projector_(route[i]->coordinates));
+					}
+				}
+				else if (route[first] == leg.to && route[first + span] == leg.from) {
+					for (size_t i = first + span + 1; i-- > first;) {
+						points.push_back(projector_(route[i]->coordinates));
+					}
 				}
-				color_palette_index++;
 			}
+		}
+
+		// Сначала подложки всех участков, затем линии, чтобы пересадки не перекрывались подложками
+		for (const std::vector<svg::Point>& points : leg_points) {
+			if (points.empty()) {
+				continue;
+			}
+			writer.BeginPolyline();
+			for (const svg::Point& point : points) {
+				writer.AddPolylinePoint(point);
+			}
+			writer.EndPolyline(styles_.route_overlay_halo);
+		}
+		for (size_t leg_index = 0; leg_index < legs.size(); ++leg_index) {
+			const std::optional<size_t> bus_index = FindBusIndex(legs[leg_index].bus);
+			if (leg_points[leg_index].empty() || !bus_index) {
+				continue;
+			}
+			svg::PathStyle style = styles_.bus_routes[GetColorIndex(*bus_index)];
+			style.class_name.clear();
+			writer.BeginPolyline();
+			for (const svg::Point& point : leg_points[leg_index]) {
+				writer.AddPolylinePoint(point);
+			}
+			writer.EndPolyline(style);
+		}
 
-			render_map.Add(general_properties);
-			render_map.Add(substrate_properties);
-			color_palette_index %= rs_.color_palette_.size();
+		for (const std::vector<svg::Point>& points : leg_points) {
+			if (!points.empty()) {
+				writer.WriteCircle(points.front(), rs_.stop_radius_, styles_.route_overlay_stop);
+			}
 		}
+		for (auto it = leg_points.rbegin(); it != leg_points.rend(); ++it) {
+			if (!it->empty()) {
+				writer.WriteCircle(it->back(), rs_.stop_radius_, styles_.route_overlay_stop);
+				break;
+			}
+		}
+	}
 
-		return render_map;
+	std::optional<size_t> RenderMap::FindBusIndex(const transport_catalogue::Bus* bus) const {
+		auto it = std::lower_bound(buses_.begin(), buses_.end(), bus,
+			[](const transport_catalogue::Bus* lhs, const transport_catalogue::Bus* rhs) {
+				return lhs->name < rhs->name;
+			});
+		if (it == buses_.end() || *it != bus) {
+			return std::nullopt;
+		}
+		return static_cast<size_t>(it - buses_.begin());
+	}
+
+	std::pair<svg::Point, std::optional<svg::Point>> RenderMap::GetBusLabelPositions(size_t bus_index) const {
+		const transport_catalogue::Bus* bus = buses_[bus_index];
+		const svg::Point first = projector_(bus->route.back()->coordinates);
+
+		// У некольцевого маршрута подписывается и вторая конечная, если она отличается от первой
+		const transport_catalogue::StopStation* middle = bus->route[bus->route.size() / 2];
+		if (!bus->is_roundtrip && middle->name != bus->route.back()->name) {
+			return { first, projector_(middle->coordinates) };
+		}
+		return { first, std::nullopt };
 	}
 
-	svg::Document RenderMap::RenderStopSymbols(const transport_catalogue::TransportCatalogue& tc) {
-		svg::Document render_map;
+	void RenderMap::RenderBusRoute(svg::StreamWriter& writer, size_t bus_index) const {
+		const transport_catalogue::Bus* bus = buses_[bus_index];
+		const svg::PathStyle& style = styles_.bus_routes[GetColorIndex(bus_index)];
 
-		for (const auto& stop : stops_) {
-			if (!tc.GetStopStationInfo(stop.name).empty()) {
-				render_map.Add(svg::Circle().SetCenter(projector_(stop.coordinates))
-					.SetRadius(rs_.stop_radius_)
-					.SetFillColor("white"));
+		if (rs_.polyline_simplification_ == PolylineSimplification::NONE || !(rs_.polyline_tolerance_ > 0.0)) {
+			writer.BeginPolyline();
+			for (const auto& stop : bus->route) {
+				writer.AddPolylinePoint(projector_(stop->coordinates));
 			}
+			writer.EndPolyline(style);
+			return;
 		}
 
-		return render_map;
+		thread_local SimplificationBuffers buffers;
+
+		// Обратный путь некольцевого маршрута повторяет прямой и на изображении с ним совпадает,
+		// поэтому при упрощении выводится только прямой путь
+		auto last = bus->is_roundtrip ? bus->route.end() : bus->route.begin() + bus->route.size() / 2 + 1;
+		buffers.points.clear();
+		for (auto it = bus->route.begin(); it != last; ++it) {
+			buffers.points.push_back(projector_((*it)->coordinates));
+		}
+
+		if (rs_.polyline_simplification_ == PolylineSimplification::DOUGLAS_PEUCKER) {
+			SimplifyDouglasPeucker(buffers, rs_.polyline_tolerance_);
+		}
+		else {
+			SnapToPixelGrid(buffers, rs_.polyline_tolerance_);
+		}
+
+		writer.BeginPolyline();
+		for (const svg::Point& point : buffers.points) {
+			writer.AddPolylinePoint(point);
+		}
+		writer.EndPolyline(style);
 	}
 
-	svg::Document RenderMap::RenderStopLabels(const transport_catalogue::TransportCatalogue& tc) {
-		svg::Document render_map;
+	void RenderMap::RenderBusLabel(svg::StreamWriter& writer, size_t bus_index) const {
+		const std::string& name = buses_[bus_index]->name;
+		const svg::TextStyle& label_style = styles_.bus_labels[GetColorIndex(bus_index)];
 
-		svg::Text substrate_properties;
-		substrate_properties
-			.SetOffset(svg::Point(rs_.stop_label_offset_[0], rs_.stop_label_offset_[1]))
-			.SetFontSize(rs_.stop_label_font_size_)
-			.SetFontFamily("Verdana");
+		const auto [first, second] = GetBusLabelPositions(bus_index);
+		writer.WriteText(first, name, styles_.bus_label_underlayer);
+		writer.WriteText(first, name, label_style);
+		if (second) {
+			writer.WriteText(*second, name, styles_.bus_label_underlayer);
+			writer.WriteText(*second, name, label_style);
+		}
+	}
 
-		svg::Text general_properties = substrate_properties;
-		general_properties
-			.SetFillColor(rs_.underlayer_color_)
-			.SetStrokeColor(rs_.underlayer_color_)
-			.SetStrokeWidth(rs_.underlayer_width_)
-			.SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-			.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+	void RenderMap::RenderStopSymbol(svg::StreamWriter& writer, size_t stop_index) const {
+		writer.WriteCircle(projector_(stops_[stop_index]->coordinates), rs_.stop_radius_, styles_.stop_symbol);
+	}
+
+	void RenderMap::RenderStopLabel(svg::StreamWriter& writer, size_t stop_index) const {
+		const transport_catalogue::StopStation* stop = stops_[stop_index];
+		const svg::Point position(projector_(stop->coordinates));
+		writer.WriteText(position, stop->name, styles_.stop_label_underlayer);
+		writer.WriteText(position, stop->name, styles_.stop_label);
+	}
 
-		for (const auto& stop : stops_) {
-			if (!tc.GetStopStationInfo(stop.name).empty()) {
-				general_properties.SetPosition(projector_(stop.coordinates))
-					.SetData(stop.name);
+	bool RenderMap::BusRouteIntersects(size_t bus_index, const Viewport& viewport) const {
+		const auto& route = buses_[bus_index]->route;
+		const double radius = rs_.line_width_ / 2;
 
-				substrate_properties.SetPosition(projector_(stop.coordinates))
-					.SetData(stop.name)
-					.SetFillColor("black");
-				render_map.Add(general_properties);
-				render_map.Add(substrate_properties);
+		svg::Point previous = projector_(route.front()->coordinates);
+		if (PointBounds(previous, radius).Intersects(viewport)) {
+			return true;
+		}
+		for (auto it = route.begin() + 1; it != route.end(); ++it) {
+			const svg::Point current = projector_((*it)->coordinates);
+			if (SegmentBounds(previous, current, radius).Intersects(viewport)) {
+				return true;
 			}
+			previous = current;
 		}
+		return false;
+	}
 
-		return render_map;
+	const RenderMap::SpatialIndex& RenderMap::GetSpatialIndex() const {
+		std::call_once(spatial_index_once_, [this]() {
+			spatial_index_ = std::make_unique<const SpatialIndex>(BuildSpatialIndex());
+		});
+		return *spatial_index_;
 	}
 
-	SphereProjector RenderMap::CreateProjector(const std::deque<transport_catalogue::Bus>& buses, const RenderSettings& rs) const {
-		std::vector<geo::Coordinates> coordinates;
-		for (const auto& bus : buses) {
-			for (const auto& stop : bus.route) {
-				coordinates.push_back(stop->coordinates);
+	RenderMap::SpatialIndex RenderMap::BuildSpatialIndex() const {
+		SpatialIndex index;
+		const double route_radius = rs_.line_width_ / 2;
+
+		index.bus_label_bounds.reserve(buses_.size());
+		for (size_t bus_index = 0; bus_index < buses_.size(); ++bus_index) {
+			const std::string& name = buses_[bus_index]->name;
+			const auto [first, second] = GetBusLabelPositions(bus_index);
+			Viewport bounds = EstimateTextBounds(first, name, styles_.bus_label_underlayer);
+			if (second) {
+				bounds.Extend(EstimateTextBounds(*second, name, styles_.bus_label_underlayer));
 			}
+			index.bus_label_bounds.push_back(bounds);
+		}
+
+		index.stop_symbol_bounds.reserve(stops_.size());
+		index.stop_label_bounds.reserve(stops_.size());
+		for (const transport_catalogue::StopStation* stop : stops_) {
+			const svg::Point position = projector_(stop->coordinates);
+			index.stop_symbol_bounds.push_back(PointBounds(position, rs_.stop_radius_));
+			index.stop_label_bounds.push_back(EstimateTextBounds(position, stop->name, styles_.stop_label_underlayer));
+		}
+
+		// Область сетки охватывает все элементы, в том числе выходящие за пределы изображения
+		index.area = { { 0.0, 0.0 }, { rs_.width_, rs_.height_ } };
+		for (const Viewport& bounds : index.bus_label_bounds) {
+			index.area.Extend(bounds);
+		}
+		for (size_t stop_index = 0; stop_index < stops_.size(); ++stop_index) {
+			index.area.Extend(index.stop_symbol_bounds[stop_index]);
+			index.area.Extend(index.stop_label_bounds[stop_index]);
+		}
+		for (const transport_catalogue::StopStation* stop : stops_) {
+			index.area.Extend(PointBounds(projector_(stop->coordinates), route_radius));
+		}
+
+		const size_t side = std::clamp<size_t>(static_cast<size_t>(std::sqrt(static_cast<double>(buses_.size() + stops_.size()))), 1, 512);
+		index.columns = side;
+		index.rows = side;
+		index.cells.resize(side * side);
+
+		const double cell_width = (index.area.max.x - index.area.min.x) / static_cast<double>(side);
+		const double cell_height = (index.area.max.y - index.area.min.y) / static_cast<double>(side);
+		auto to_cell = [side](double value, double origin, double cell_size) {
+			const double cell = cell_size > 0 ? std::floor((value - origin) / cell_size) : 0.0;
+			return static_cast<size_t>(std::clamp(cell, 0.0, static_cast<double>(side - 1)));
+		};
+
+		// Добавляет элемент во все ячейки, которые задевают его границы
+		auto insert = [&](const Viewport& bounds, size_t element, std::vector<size_t> SpatialIndex::Cell::* layer) {
+			const size_t first_column = to_cell(bounds.min.x, index.area.min.x, cell_width);
+			const size_t last_column = to_cell(bounds.max.x, index.area.min.x, cell_width);
+			const size_t first_row = to_cell(bounds.min.y, index.area.min.y, cell_height);
+			const size_t last_row = to_cell(bounds.max.y, index.area.min.y, cell_height);
+			for (size_t row = first_row; row <= last_row; ++row) {
+				for (size_t column = first_column; column <= last_column; ++column) {
+					std::vector<size_t>& elements = index.cells[row * side + column].*layer;
+					if (elements.empty() || elements.back() != element) {
+						elements.push_back(element);
+					}
+				}
+			}
+		};
+
+		for (size_t bus_index = 0; bus_index < buses_.size(); ++bus_index) {
+			const auto& route = buses_[bus_index]->route;
+			svg::Point previous = projector_(route.front()->coordinates);
+			insert(PointBounds(previous, route_radius), bus_index, &SpatialIndex::Cell::bus_routes);
+			for (auto it = route.begin() + 1; it != route.end(); ++it) {
+				const svg::Point current = projector_((*it)->coordinates);
+				insert(SegmentBounds(previous, current, route_radius), bus_index, &SpatialIndex::Cell::bus_routes);
+				previous = current;
+			}
+			insert(index.bus_label_bounds[bus_index], bus_index, &SpatialIndex::Cell::bus_labels);
+		}
+
+		for (size_t stop_index = 0; stop_index < stops_.size(); ++stop_index) {
+			Viewport bounds = index.stop_symbol_bounds[stop_index];
+			bounds.Extend(index.stop_label_bounds[stop_index]);
+			insert(bounds, stop_index, &SpatialIndex::Cell::stops);
+		}
+
+		return index;
+	}
+
+	RenderMap::Styles RenderMap::CreateStyles(const RenderSettings& rs) {
+		Styles styles;
+
+		svg::PathStyle underlayer;
+		underlayer.fill_color = rs.underlayer_color_;
+		underlayer.stroke_color = rs.underlayer_color_;
+		underlayer.stroke_width = rs.underlayer_width_;
+		underlayer.line_cap = svg::StrokeLineCap::ROUND;
+		underlayer.line_join = svg::StrokeLineJoin::ROUND;
+
+		svg::TextStyle bus_label;
+		bus_label.offset = svg::Point(rs.bus_label_offset_[0], rs.bus_label_offset_[1]);
+		bus_label.font_size = rs.bus_label_font_size_;
+		bus_label.font_family = "Verdana";
+		bus_label.font_weight = "bold";
+
+		styles.bus_label_underlayer = bus_label;
+		styles.bus_label_underlayer.path = underlayer;
+		styles.bus_label_underlayer.path.class_name = "bu";
+
+		for (const svg::Color& color : rs.color_palette_) {
+			svg::PathStyle route;
+			route.fill_color = svg::NoneColor;
+			route.stroke_color = color;
+			route.stroke_width = rs.line_width_;
+			route.line_cap = svg::StrokeLineCap::ROUND;
+			route.line_join = svg::StrokeLineJoin::ROUND;
+			route.class_name = "r"s + std::to_string(styles.bus_routes.size());
+			styles.bus_routes.push_back(std::move(route));
+
+			styles.bus_labels.push_back(bus_label);
+			styles.bus_labels.back().path.fill_color = color;
+			styles.bus_labels.back().path.class_name = "b"s + std::to_string(styles.bus_labels.size() - 1);
+		}
+
+		styles.stop_symbol.fill_color = "white";
+		styles.stop_symbol.class_name = "s";
+
+		svg::TextStyle stop_label;
+		stop_label.offset = svg::Point(rs.stop_label_offset_[0], rs.stop_label_offset_[1]);
+		stop_label.font_size = rs.stop_label_font_size_;
+		stop_label.font_family = "Verdana";
+
+		styles.stop_label_underlayer = stop_label;
+		styles.stop_label_underlayer.path = underlayer;
+		styles.stop_label_underlayer.path.class_name = "su";
+
+		styles.stop_label = stop_label;
+		styles.stop_label.path.fill_color = "black";
+		styles.stop_label.path.class_name = "sl";
+
+		// Выделение маршрута поездки: линия поверх подложки цвета подложки надписей
+		styles.route_overlay_halo = underlayer;
+		styles.route_overlay_halo.fill_color = svg::NoneColor;
+		styles.route_overlay_halo.stroke_width = rs.line_width_ + 2 * rs.underlayer_width_;
+
+		styles.route_overlay_stop.fill_color = "white";
+		styles.route_overlay_stop.stroke_color = "black";
+		styles.route_overlay_stop.stroke_width = rs.stop_radius_ / 2;
+
+		return styles;
+	}
+
+	std::vector<const transport_catalogue::Bus*> RenderMap::DropEmptyRoutes(std::vector<const transport_catalogue::Bus*> buses) {
+		buses.erase(std::remove_if(buses.begin(), buses.end(),
+			[](const transport_catalogue::Bus* bus) {
+				return bus->route.empty();
+			}),
+			buses.end());
+		return buses;
+	}
+
+	SphereProjector RenderMap::CreateProjector(const std::vector<const transport_catalogue::StopStation*>& stops, const RenderSettings& rs) {
+		std::vector<geo::Coordinates> coordinates;
+		coordinates.reserve(stops.size());
+		for (const transport_catalogue::StopStation* stop : stops) {
+			coordinates.push_back(stop->coordinates);
 		}
 
 		return SphereProjector(coordinates.begin(), coordinates.end(), rs.width_, rs.height_, rs.padding_);
 	}
 
-	std::set<transport_catalogue::StopStation, RenderMap::StopStationCompare> RenderMap::CollectUniqueStops(
-		const std::deque<transport_catalogue::Bus>& buses) const
+	std::vector<const transport_catalogue::StopStation*> RenderMap::CollectUniqueStops(
+		const std::vector<const transport_catalogue::Bus*>& buses)
 	{
-		std::set<transport_catalogue::StopStation, StopStationCompare> stops;
-		for (const auto& bus : buses) {
-			for (const auto& stop : bus.route) {
-				stops.insert(*stop);
-			}
+		std::vector<const transport_catalogue::StopStation*> stops;
+		for (const transport_catalogue::Bus* bus : buses) {
+			stops.insert(stops.end(), bus->route.begin(), bus->route.end());
 		}
+
+		// Названия остановок в справочнике уникальны, поэтому одинаковые названия означают один и тот же указатель
+		std::sort(stops.begin(), stops.end(),
+			[](const transport_catalogue::StopStation* lhs, const transport_catalogue::StopStation* rhs) {
+				return lhs->name < rhs->name;
+			}
+		);
+		stops.erase(std::unique(stops.begin(), stops.end()), stops.end());
+
 		return stops;
 	}
 }
\ No newline at end of file
@@ -4,12 +4,23 @@
 #include "svg.h"
 
 #include <algorithm>
-#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
 
 namespace map_renderer {
 
     using namespace std::literals;
 
+    // Способ упрощения ломаных маршрутов перед выводом
+    enum class PolylineSimplification {
+        NONE,              // выводятся все остановки маршрута
+        DOUGLAS_PEUCKER,   // отбрасываются точки, отклоняющиеся от упрощённой линии меньше чем на допуск
+        PIXEL_GRID,        // точки привязываются к сетке с шагом в допуск, повторы подряд отбрасываются
+    };
+
     struct RenderSettings {
         double width_ = 0.0;
         double height_ = 0.0;
@@ -29,8 +40,75 @@ namespace map_renderer {
         double underlayer_width_ = 0;
 
         std::vector<svg::Color> color_palette_{};
+
+        // Допуск упрощения задаётся в единицах SVG-изображения (пикселях)
+        PolylineSimplification polyline_simplification_ = PolylineSimplification::NONE;
+        double polyline_tolerance_ = 0.0;
+
+        // Общие стили выводятся один раз в <style>, элементы ссылаются на них по имени класса
+        bool css_styles_ = false;
+        // Число знаков после запятой в координатах; без значения координаты выводятся с точностью потока
+        std::optional<int> coordinate_precision_;
+    };
+
+    inline bool operator==(const RenderSettings& lhs, const RenderSettings& rhs) {
+        return lhs.width_ == rhs.width_ && lhs.height_ == rhs.height_ && lhs.padding_ == rhs.padding_
+            && lhs.line_width_ == rhs.line_width_ && lhs.stop_radius_ == rhs.stop_radius_
+            && lhs.bus_label_font_size_ == rhs.bus_label_font_size_ && lhs.bus_label_offset_ == rhs.bus_label_offset_
+            && lhs.stop_label_font_size_ == rhs.stop_label_font_size_ && lhs.stop_label_offset_ == rhs.stop_label_offset_
+            && lhs.underlayer_color_ == rhs.underlayer_color_ && lhs.underlayer_width_ == rhs.underlayer_width_
+            && lhs.color_palette_ == rhs.color_palette_
+            && lhs.polyline_simplification_ == rhs.polyline_simplification_ && lhs.polyline_tolerance_ == rhs.polyline_tolerance_
+            && lhs.css_styles_ == rhs.css_styles_ && lhs.coordinate_precision_ == rhs.coordinate_precision_;
+    }
+
+    inline bool operator!=(const RenderSettings& lhs, const RenderSettings& rhs) {
+        return !(lhs == rhs);
+    }
+
+    // Прямоугольная область в координатах SVG-изображения
+    struct Viewport {
+        svg::Point min;
+        svg::Point max;
+
+        bool Intersects(const Viewport& other) const {
+            return min.x <= other.max.x && other.min.x <= max.x
+                && min.y <= other.max.y && other.min.y <= max.y;
+        }
+
+        void Extend(const Viewport& other) {
+            min = { std::min(min.x, other.min.x), std::min(min.y, other.min.y) };
+            max = { std::max(max.x, other.max.x), std::max(max.y, other.max.y) };
+        }
+    };
+
+    inline bool operator==(const Viewport& lhs, const Viewport& rhs) {
+        return lhs.min.x == rhs.min.x && lhs.min.y == rhs.min.y && lhs.max.x == rhs.max.x && lhs.max.y == rhs.max.y;
+    }
+
+    struct ViewportHash {
+        size_t operator()(const Viewport& viewport) const {
+            std::hash<double> hasher;
+            size_t h = hasher(viewport.min.x);
+            h = h * 37 + hasher(viewport.min.y);
+            h = h * 37 + hasher(viewport.max.x);
+            h = h * 37 + hasher(viewport.max.y);
+            return h;
+        }
+    };
+
+    // Участок маршрута, проезжаемый на одном автобусе без пересадок: span_count перегонов от from до to
+    struct RouteLeg {
+        const transport_catalogue::Bus* bus = nullptr;
+        const transport_catalogue::StopStation* from = nullptr;
+        const transport_catalogue::StopStation* to = nullptr;
+        int span_count = 0;
     };
 
+    // Область тайла с адресом z/x/y: изображение размером width_ x height_ делится на 2^z x 2^z равных тайлов.
+    // Выбрасывает std::out_of_range, если адрес не существует
+    Viewport GetTileViewport(const RenderSettings& rs, int zoom, int x, int y);
+
     inline const double EPSILON = 1e-6;
     inline bool IsZero(double value) {
         return std::abs(value) < EPSILON;
@@ -105,38 +183,119 @@ namespace map_renderer {
         double zoom_coeff_ = 0;
     };
 
+    /*
+     * Отрисовка карты работает с указателями на данные справочника и ничего из него не копирует.
+     * buses — маршруты, отсортированные по названию; справочник должен жить дольше объекта RenderMap
+     */
     class RenderMap {
     public:
-        struct StopStationCompare {
-            bool operator()(const transport_catalogue::StopStation& lhs,
-                const transport_catalogue::StopStation& rhs) const {
-                return lhs.name < rhs.name;
-            }
-        };
-
-        RenderMap(const RenderSettings& rs, const std::deque<transport_catalogue::Bus>& buses)
+        RenderMap(const RenderSettings& rs, std::vector<const transport_catalogue::Bus*> buses)
             : rs_(rs)
-            , buses_(buses)
-            , stops_(CollectUniqueStops(buses))
-            , projector_(CreateProjector(buses, rs))
+            , buses_(DropEmptyRoutes(std::move(buses)))
+            , stops_(CollectUniqueStops(buses_))
+            , projector_(CreateProjector(stops_, rs))
+            , styles_(CreateStyles(rs))
         {
         }
 
-        svg::Document RenderAllLayers(const transport_catalogue::TransportCatalogue& tc);
+        // Выводит карту в поток, элементы записываются сразу по мере обхода данных.
+        // При thread_count > 1 последовательность элементов всех слоёв делится на части, которые отрисовываются
+        // параллельно в отдельные буферы и затем склеиваются по порядку; результат совпадает с однопоточным
+        void RenderAllLayers(std::ostream& out, size_t thread_count = 1) const;
+
+        // Выводит только элементы, задевающие область viewport, с сохранением порядка слоёв и цветов полной карты.
+        // Элементы ищутся по пространственному индексу, который строится при первом вызове
+        void RenderViewport(std::ostream& out, const Viewport& viewport) const;
+
+        // Выводит только элементы поверх полной карты (без заголовка и закрывающего тега):
+        // выделенные линии проезжаемых участков в цветах их маршрутов и отметки остановок посадки и высадки
+        void RenderRouteOverlay(std::ostream& out, const std::vector<RouteLeg>& legs) const;
 
     private:
-        SphereProjector CreateProjector(const std::deque<transport_catalogue::Bus>& buses, const RenderSettings& rs) const;
-        std::set<transport_catalogue::StopStation, StopStationCompare> CollectUniqueStops(const std::deque<transport_catalogue::Bus>& buses) const;
+        // Атрибуты, общие для многих элементов карты, подготавливаются один раз.
+        // Стили, зависящие от цвета маршрута, хранятся по индексу цвета в палитре
+        struct Styles {
+            std::vector<svg::PathStyle> bus_routes;
+            svg::TextStyle bus_label_underlayer;
+            std::vector<svg::TextStyle> bus_labels;
+            svg::PathStyle stop_symbol;
+            svg::TextStyle stop_label_underlayer;
+            svg::TextStyle stop_label;
+            svg::PathStyle route_overlay_halo;
+            svg::PathStyle route_overlay_stop;
+        };
+
+        // Равномерная сетка над картой: в каждой ячейке хранятся индексы маршрутов и остановок, задевающих её.
+        // Для подписей и символов остановок дополнительно хранятся их оценочные границы
+        struct SpatialIndex {
+            struct Cell {
+                std::vector<size_t> bus_routes;
+                std::vector<size_t> bus_labels;
+                std::vector<size_t> stops;
+            };
 
-        svg::Document RenderBusRoutes();
-        svg::Document RenderBusLabels();
-        svg::Document RenderStopSymbols(const transport_catalogue::TransportCatalogue& tc);
-        svg::Document RenderStopLabels(const transport_catalogue::TransportCatalogue& tc);
+            Viewport area;
+            size_t columns = 1;
+            size_t rows = 1;
+            std::vector<Cell> cells;
+
+            std::vector<Viewport> bus_label_bounds;
+            std::vector<Viewport> stop_symbol_bounds;
+            std::vector<Viewport> stop_label_bounds;
+        };
+
+        static std::vector<const transport_catalogue::Bus*> DropEmptyRoutes(std::vector<const transport_catalogue::Bus*> buses);
+        static SphereProjector CreateProjector(const std::vector<const transport_catalogue::StopStation*>& stops, const RenderSettings& rs);
+        static Styles CreateStyles(const RenderSettings& rs);
+
+        // Остановки, через которые проходит хотя бы один маршрут, без повторов и отсортированные по названию.
+        // Остановки берутся из маршрутов, поэтому у каждой из них заведомо есть автобусы
+        // и отдельная проверка по справочнику при отрисовке не нужна
+        static std::vector<const transport_catalogue::StopStation*> CollectUniqueStops(const std::vector<const transport_catalogue::Bus*>& buses);
+
+        // Цвет маршрута определяется его позицией в отсортированном списке
+        size_t GetColorIndex(size_t bus_index) const {
+            return bus_index % rs_.color_palette_.size();
+        }
+
+        // Позиция маршрута в отсортированном списке, если маршрут есть на карте
+        std::optional<size_t> FindBusIndex(const transport_catalogue::Bus* bus) const;
+
+        // Точки, в которых подписывается маршрут: первая конечная и, для некольцевого маршрута, вторая
+        std::pair<svg::Point, std::optional<svg::Point>> GetBusLabelPositions(size_t bus_index) const;
+
+        // Элементы всех слоёв пронумерованы подряд: линии маршрутов, названия маршрутов, символы и названия остановок.
+        // Выводит элементы с номерами из [first, last)
+        void RenderElements(svg::StreamWriter& writer, size_t first, size_t last) const;
+
+        size_t GetElementCount() const {
+            return 2 * (buses_.size() + stops_.size());
+        }
+
+        void RenderBusRoute(svg::StreamWriter& writer, size_t bus_index) const;
+        void RenderBusLabel(svg::StreamWriter& writer, size_t bus_index) const;
+        void RenderStopSymbol(svg::StreamWriter& writer, size_t stop_index) const;
+        void RenderStopLabel(svg::StreamWriter& writer, size_t stop_index) const;
+
+        svg::StreamWriter::Options GetWriterOptions() const {
+            return { rs_.coordinate_precision_, rs_.css_styles_ };
+        }
+
+        // Выводит таблицу общих стилей, если она включена в настройках
+        void RenderStyleSheet(svg::StreamWriter& writer) const;
+
+        const SpatialIndex& GetSpatialIndex() const;
+        SpatialIndex BuildSpatialIndex() const;
+        bool BusRouteIntersects(size_t bus_index, const Viewport& viewport) const;
 
     private:
-        const RenderSettings rs_;
-        const std::deque<transport_catalogue::Bus> buses_;
-        const std::set<transport_catalogue::StopStation, StopStationCompare> stops_;
+        const RenderSettings& rs_;
+        const std::vector<const transport_catalogue::Bus*> buses_;
+        const std::vector<const transport_catalogue::StopStation*> stops_;
         const SphereProjector projector_;
+        const Styles styles_;
+
+        mutable std::once_flag spatial_index_once_;
+        mutable std::unique_ptr<const SpatialIndex> spatial_index_;
     };
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * Оценка памяти, занятой контейнерами в куче. Оценки приблизительные: размеры служебных узлов
+ * взяты по типичной реализации стандартной библиотеки, запас аллокатора не учитывается.
+ * Объём самого объекта контейнера (sizeof) не входит в оценку — он учитывается там, где объект хранится
+ */
+namespace memory_stats {
+
+    // Оценки по именам внутренних контейнеров, в байтах
+    using Report = std::map<std::string, size_t>;
+
+    inline size_t Total(const Report& report) {
+        size_t total = 0;
+        for (const auto& [name, bytes] : report) {
+            total += bytes;
+        }
+        return total;
+    }
+
+    // Короткие строки хранятся внутри объекта строки и кучу не занимают
+    inline size_t HeapBytes(const std::string& str) {
+        return str.capacity() >= sizeof(std::string) ? str.capacity() + 1 : 0;
+    }
+
+    template <typename T>
+    size_t HeapBytes(const std::vector<T>& vec) {
+        return vec.capacity() * sizeof(T);
+    }
+
+    // Элементы дека лежат блоками по 512 байт, на каждый блок приходится указатель в карте блоков
+    template <typename T>
+    size_t HeapBytes(const std::deque<T>& deq) {
+        constexpr size_t block_size = 512;
+        const size_t per_block = sizeof(T) < block_size ? block_size / sizeof(T) : 1;
+        const size_t blocks = deq.size() / per_block + 1;
+        return blocks * (std::max(block_size, sizeof(T)) + sizeof(void*));
+    }
+
+    // Узел хеш-таблицы: указатель на следующий узел, значение и сохранённый хеш
+    template <typename Key, typename Value, typename Hash, typename Equal>
+    size_t HeapBytes(const std::unordered_map<Key, Value, Hash, Equal>& table) {
+        using Node = std::pair<const Key, Value>;
+        return table.bucket_count() * sizeof(void*) + table.size() * (sizeof(void*) + sizeof(Node) + sizeof(size_t));
+    }
+
+    template <typename Key, typename Hash, typename Equal>
+    size_t HeapBytes(const std::unordered_set<Key, Hash, Equal>& table) {
+        return table.bucket_count() * sizeof(void*) + table.size() * (sizeof(void*) + sizeof(Key) + sizeof(size_t));
+    }
+
+    // Узел красно-чёрного дерева: цвет и три указателя
+    inline constexpr size_t TREE_NODE_HEADER = 4 * sizeof(void*);
+
+    template <typename Key, typename Value, typename Compare>
+    size_t HeapBytes(const std::map<Key, Value, Compare>& tree) {
+        return tree.size() * (TREE_NODE_HEADER + sizeof(std::pair<const Key, Value>));
+    }
+
+    template <typename Key, typename Compare>
+    size_t HeapBytes(const std::set<Key, Compare>& tree) {
+        return tree.size() * (TREE_NODE_HEADER + sizeof(Key));
+    }
+
+}  // namespace memory_stats
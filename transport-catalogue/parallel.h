@@ -0,0 +1,201 @@
+#pragma once
+
+#include "profile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace parallel {
+
+    // Число потоков по умолчанию: столько, сколько аппаратных потоков доступно (но не меньше одного)
+    inline size_t DefaultThreadCount() {
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    /*
+     * Вызывает func(index) для каждого index из [0, count), раздавая индексы потокам по одному
+     * через общий атомарный счётчик, поэтому тяжёлые и лёгкие задачи распределяются равномерно.
+     * Порядок вызовов не определён: результаты следует складывать в заранее выделенные ячейки по index.
+     * Первое выброшенное исключение пробрасывается вызывающему после завершения всех потоков.
+     * Выделения памяти в рабочих потоках относятся к тому же этапу, что и в вызывающем.
+     * Потоки создаются заново при каждом вызове; если вызовов много и потокам нужна своя память
+     * между ними (thread_local), используйте ThreadPool
+     */
+    template <typename Func>
+    void ForEachIndex(size_t count, size_t thread_count, Func func) {
+        thread_count = std::min(thread_count, count);
+        if (thread_count <= 1) {
+            for (size_t index = 0; index < count; ++index) {
+                func(index);
+            }
+            return;
+        }
+
+        std::atomic<size_t> next_index{ 0 };
+        std::atomic<bool> failed{ false };
+        std::exception_ptr error;
+        std::mutex error_mutex;
+
+        const profile::AllocationTag allocation_tag = profile::GetAllocationTag();
+        auto worker = [&]() {
+            profile::ScopedAllocationTag scoped_tag(allocation_tag);
+            for (size_t index = next_index++; index < count && !failed; index = next_index++) {
+                try {
+                    func(index);
+                }
+                catch (...) {
+                    std::lock_guard guard(error_mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(thread_count - 1);
+        for (size_t i = 1; i < thread_count; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /*
+     * Потоки, которые создаются один раз и выполняют несколько ForEachIndex подряд, поэтому их
+     * thread_local-данные (например, память для поиска маршрутов) переживают отдельные вызовы.
+     * Вызывающий поток работает вместе с thread_count - 1 потоками пула. ForEachIndex распределяет
+     * индексы и пробрасывает исключения так же, как parallel::ForEachIndex, и не выделяет памяти;
+     * вызывать его одновременно из нескольких потоков или изнутри func нельзя
+     */
+    class ThreadPool {
+    public:
+        explicit ThreadPool(size_t thread_count) {
+            const size_t worker_count = std::max<size_t>(1, thread_count) - 1;
+            workers_.reserve(worker_count);
+            for (size_t i = 0; i < worker_count; ++i) {
+                workers_.emplace_back([this]() { WorkerLoop(); });
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool() {
+            {
+                std::lock_guard guard(mutex_);
+                stop_ = true;
+            }
+            task_ready_.notify_all();
+            for (std::thread& worker : workers_) {
+                worker.join();
+            }
+        }
+
+        size_t GetThreadCount() const {
+            return workers_.size() + 1;
+        }
+
+        template <typename Func>
+        void ForEachIndex(size_t count, Func func) {
+            if (workers_.empty() || count <= 1) {
+                for (size_t index = 0; index < count; ++index) {
+                    func(index);
+                }
+                return;
+            }
+
+            {
+                std::lock_guard guard(mutex_);
+                task_ = &func;
+                call_ = [](void* task, size_t index) { (*static_cast<Func*>(task))(index); };
+                count_ = count;
+                next_index_ = 0;
+                failed_ = false;
+                allocation_tag_ = profile::GetAllocationTag();
+                busy_workers_ = workers_.size();
+                ++generation_;
+            }
+            task_ready_.notify_all();
+            RunIndices();
+
+            std::unique_lock lock(mutex_);
+            task_done_.wait(lock, [this]() { return busy_workers_ == 0; });
+            task_ = nullptr;
+            if (error_) {
+                std::rethrow_exception(std::exchange(error_, nullptr));
+            }
+        }
+
+    private:
+        void WorkerLoop() {
+            uint64_t seen_generation = 0;
+            while (true) {
+                {
+                    std::unique_lock lock(mutex_);
+                    task_ready_.wait(lock, [&]() { return stop_ || generation_ != seen_generation; });
+                    if (stop_) {
+                        return;
+                    }
+                    seen_generation = generation_;
+                }
+                {
+                    profile::ScopedAllocationTag scoped_tag(allocation_tag_);
+                    RunIndices();
+                }
+                std::lock_guard guard(mutex_);
+                if (--busy_workers_ == 0) {
+                    task_done_.notify_one();
+                }
+            }
+        }
+
+        void RunIndices() {
+            for (size_t index = next_index_++; index < count_ && !failed_; index = next_index_++) {
+                try {
+                    call_(task_, index);
+                }
+                catch (...) {
+                    std::lock_guard guard(mutex_);
+                    if (!error_) {
+                        error_ = std::current_exception();
+                    }
+                    failed_ = true;
+                }
+            }
+        }
+
+        std::vector<std::thread> workers_;
+        std::mutex mutex_;
+        std::condition_variable task_ready_;
+        std::condition_variable task_done_;
+        bool stop_ = false;
+        uint64_t generation_ = 0;
+        size_t busy_workers_ = 0;
+
+        // Текущее задание; меняется под mutex_, пока потоки пула его не выполняют
+        void* task_ = nullptr;
+        void (*call_)(void*, size_t) = nullptr;
+        size_t count_ = 0;
+        profile::AllocationTag allocation_tag_ = profile::AllocationTag::OTHER;
+        std::atomic<size_t> next_index_{ 0 };
+        std::atomic<bool> failed_{ false };
+        std::exception_ptr error_;
+    };
+
+}  // namespace parallel
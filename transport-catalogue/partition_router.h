@@ -0,0 +1,462 @@
+#pragma once
+
+#include "graph.h"
+#include "parallel.h"
+#include "profile.h"
+#include "route_engine.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+    /*
+     * Поиск маршрутов по разбиению графа на ячейки (в духе customizable route planning).
+     * Разбиение зависит только от связей между вершинами и строится один раз. Вход ячейки — вершина,
+     * в которую ведёт ребро из другой ячейки, выход — вершина, из которой ребро ведёт в другую ячейку.
+     * Настройка (customization) считает для каждой ячейки кратчайшие расстояния внутри неё от каждого
+     * входа до каждого выхода; ячейки настраиваются независимо и параллельно, а после изменения весов
+     * пересчитываются только те, внутри которых лежат изменённые рёбра.
+     * Запрос — алгоритм Дейкстры, который в ячейках начала и конца идёт по рёбрам графа,
+     * а остальные ячейки проходит по расстояниям от входа до выхода
+     */
+    template <typename Weight>
+    class PartitionRouter final : public RouteEngine<Weight> {
+    private:
+        using Graph = DirectedWeightedGraph<Weight>;
+
+    public:
+        // max_cell_size — наибольшее число вершин в ячейке; при thread_count > 1 ячейки настраиваются параллельно
+        PartitionRouter(const Graph& graph, size_t max_cell_size, size_t thread_count = 1);
+
+        bool BuildRoute(VertexId from, VertexId to, RouteInfo<Weight>& route) const override;
+
+        // Настраивает заново ячейки, внутри которых лежат изменённые рёбра; их число — в счётчике partition.customized_cells
+        void UpdateEdgeWeights(const std::vector<EdgeId>& changed_edges, size_t thread_count) override;
+
+        memory_stats::Report MemoryStats() const override;
+
+        // Оценка памяти без расстояний ячеек (их размер зависит от разбиения): разметка вершин и рабочие массивы одного потока
+        static size_t EstimateMemory(size_t vertex_count) {
+            return vertex_count * (3 * sizeof(uint32_t) + sizeof(size_t)) + EstimateWorkspaceMemory(vertex_count);
+        }
+
+        size_t GetCellCount() const {
+            return cells_.size();
+        }
+
+    private:
+        using QueueEntry = std::pair<Weight, VertexId>;
+
+        struct Cell {
+            std::vector<VertexId> vertices;
+            std::vector<VertexId> entries;
+            std::vector<VertexId> exits;
+            // Расстояние от entries[i] до exits[j] внутри ячейки — distances[i * exits.size() + j]
+            std::vector<std::optional<Weight>> distances;
+        };
+
+        /*
+         * Рабочие массивы потока для поиска по всему графу. Выход чужой ячейки, достигнутый по расстоянию
+         * ячейки, хранит prev_edge = NO_EDGE и вход, из которого пришёл, в prev_vertex
+         */
+        struct QueryWorkspace {
+            std::vector<Weight> distance;
+            std::vector<EdgeId> prev_edge;
+            std::vector<VertexId> prev_vertex;
+            std::vector<uint64_t> reached_mark;
+            std::vector<QueueEntry> queue;
+            uint64_t search_mark = 0;
+        };
+
+        // Рабочие массивы потока для поиска внутри одной ячейки; вершины нумеруются местными номерами (local_index_)
+        struct CellWorkspace {
+            std::vector<Weight> distance;
+            std::vector<EdgeId> prev_edge;
+            std::vector<uint64_t> reached_mark;
+            std::vector<std::pair<Weight, uint32_t>> queue;
+            uint64_t search_mark = 0;
+
+            bool IsReached(uint32_t local_vertex) const {
+                return reached_mark[local_vertex] == search_mark;
+            }
+        };
+
+        static size_t EstimateWorkspaceMemory(size_t vertex_count) {
+            return vertex_count * (sizeof(Weight) + sizeof(EdgeId) + sizeof(VertexId) + sizeof(uint64_t) + sizeof(QueueEntry));
+        }
+
+        static QueryWorkspace& GetQueryWorkspace(size_t vertex_count) {
+            thread_local QueryWorkspace workspace;
+            if (workspace.distance.size() < vertex_count) {
+                workspace.distance.resize(vertex_count);
+                workspace.prev_edge.resize(vertex_count);
+                workspace.prev_vertex.resize(vertex_count);
+                workspace.reached_mark.resize(vertex_count, 0);
+            }
+            return workspace;
+        }
+
+        static CellWorkspace& GetCellWorkspace(size_t cell_size) {
+            thread_local CellWorkspace workspace;
+            if (workspace.distance.size() < cell_size) {
+                workspace.distance.resize(cell_size);
+                workspace.prev_edge.resize(cell_size);
+                workspace.reached_mark.resize(cell_size, 0);
+            }
+            return workspace;
+        }
+
+        void Partition();
+
+        void FindBoundaries();
+
+        void Customize(const std::vector<uint32_t>& cell_ids, size_t thread_count);
+
+        void CustomizeCell(uint32_t cell_id);
+
+        // Кратчайшие расстояния от source до вершин её ячейки по рёбрам, не выходящим из ячейки
+        void SearchCell(uint32_t cell_id, VertexId source, CellWorkspace& workspace) const;
+
+        // Дописывает в edges рёбра кратчайшего пути от входа до выхода ячейки в обратном порядке
+        void UnpackCellPath(VertexId entry, VertexId exit, std::vector<EdgeId>& edges) const;
+
+        static constexpr uint32_t NO_INDEX = std::numeric_limits<uint32_t>::max();
+        static constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+
+        const Graph& graph_;
+        size_t max_cell_size_;
+        std::vector<uint32_t> cell_of_;
+        // Номер вершины в Cell::vertices её ячейки
+        std::vector<uint32_t> local_index_;
+        // Номер вершины в Cell::entries её ячейки или NO_INDEX, если вершина — не вход
+        std::vector<uint32_t> entry_index_;
+        // Рёбра из вершины v в другие ячейки — cut_edges_[cut_edge_offsets_[v]..cut_edge_offsets_[v + 1])
+        std::vector<size_t> cut_edge_offsets_;
+        std::vector<EdgeId> cut_edges_;
+        std::vector<Cell> cells_;
+    };
+
+    template <typename Weight>
+    PartitionRouter<Weight>::PartitionRouter(const Graph& graph, size_t max_cell_size, size_t thread_count)
+        : graph_(graph)
+        , max_cell_size_(max_cell_size)
+    {
+        if (max_cell_size_ == 0) {
+            throw std::invalid_argument("PartitionRouter: cell size must be positive");
+        }
+        if (graph_.GetVertexCount() >= NO_INDEX) {
+            throw std::length_error("PartitionRouter: too many vertices");
+        }
+
+        profile::ScopedPhase phase("router_precompute", profile::AllocationTag::ROUTER);
+        Partition();
+        FindBoundaries();
+
+        std::vector<uint32_t> cell_ids(cells_.size());
+        std::iota(cell_ids.begin(), cell_ids.end(), 0);
+        Customize(cell_ids, thread_count);
+    }
+
+    /*
+     * Ячейки растут обходом в ширину по рёбрам без учёта направления: от первой нераспределённой вершины,
+     * пока в ячейке меньше max_cell_size_ вершин. Связанные вершины попадают в одну ячейку,
+     * поэтому рёбер между ячейками (и входов с выходами) немного
+     */
+    template <typename Weight>
+    void PartitionRouter<Weight>::Partition() {
+        const size_t vertex_count = graph_.GetVertexCount();
+        const size_t edge_count = graph_.GetEdgeCount();
+
+        // Соседи вершины v без учёта направления рёбер — neighbors[offsets[v]..offsets[v + 1])
+        std::vector<size_t> offsets(vertex_count + 1, 0);
+        for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            ++offsets[edge.from + 1];
+            ++offsets[edge.to + 1];
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        std::vector<uint32_t> neighbors(offsets.back());
+        std::vector<size_t> next_slot(offsets.begin(), offsets.end() - 1);
+        for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            neighbors[next_slot[edge.from]++] = static_cast<uint32_t>(edge.to);
+            neighbors[next_slot[edge.to]++] = static_cast<uint32_t>(edge.from);
+        }
+
+        cell_of_.assign(vertex_count, NO_INDEX);
+        for (VertexId seed = 0; seed < vertex_count; ++seed) {
+            if (cell_of_[seed] != NO_INDEX) {
+                continue;
+            }
+            const uint32_t cell_id = static_cast<uint32_t>(cells_.size());
+            std::vector<VertexId>& vertices = cells_.emplace_back().vertices;
+            cell_of_[seed] = cell_id;
+            vertices.push_back(seed);
+            // Вершины ячейки служат очередью обхода
+            for (size_t head = 0; head < vertices.size() && vertices.size() < max_cell_size_; ++head) {
+                const VertexId vertex = vertices[head];
+                for (size_t i = offsets[vertex]; i < offsets[vertex + 1] && vertices.size() < max_cell_size_; ++i) {
+                    if (cell_of_[neighbors[i]] == NO_INDEX) {
+                        cell_of_[neighbors[i]] = cell_id;
+                        vertices.push_back(neighbors[i]);
+                    }
+                }
+            }
+        }
+
+        profile::AddCounter("partition.cells", cells_.size());
+    }
+
+    template <typename Weight>
+    void PartitionRouter<Weight>::FindBoundaries() {
+        const size_t vertex_count = graph_.GetVertexCount();
+        local_index_.assign(vertex_count, NO_INDEX);
+        for (const Cell& cell : cells_) {
+            for (size_t i = 0; i < cell.vertices.size(); ++i) {
+                local_index_[cell.vertices[i]] = static_cast<uint32_t>(i);
+            }
+        }
+
+        std::vector<bool> is_entry(vertex_count, false);
+        cut_edge_offsets_.assign(vertex_count + 1, 0);
+        for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+            cut_edge_offsets_[vertex] = cut_edges_.size();
+            for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                const VertexId to = graph_.GetEdge(edge_id).to;
+                if (cell_of_[to] != cell_of_[vertex]) {
+                    cut_edges_.push_back(edge_id);
+                    is_entry[to] = true;
+                }
+            }
+        }
+        cut_edge_offsets_[vertex_count] = cut_edges_.size();
+
+        entry_index_.assign(vertex_count, NO_INDEX);
+        size_t entry_count = 0;
+        size_t exit_count = 0;
+        for (Cell& cell : cells_) {
+            for (const VertexId vertex : cell.vertices) {
+                if (is_entry[vertex]) {
+                    entry_index_[vertex] = static_cast<uint32_t>(cell.entries.size());
+                    cell.entries.push_back(vertex);
+                }
+                if (cut_edge_offsets_[vertex] != cut_edge_offsets_[vertex + 1]) {
+                    cell.exits.push_back(vertex);
+                }
+            }
+            entry_count += cell.entries.size();
+            exit_count += cell.exits.size();
+        }
+
+        profile::AddCounter("partition.cut_edges", cut_edges_.size());
+        profile::AddCounter("partition.entries", entry_count);
+        profile::AddCounter("partition.exits", exit_count);
+    }
+
+    template <typename Weight>
+    void PartitionRouter<Weight>::Customize(const std::vector<uint32_t>& cell_ids, size_t thread_count) {
+        parallel::ForEachIndex(cell_ids.size(), thread_count, [&](size_t index) {
+            CustomizeCell(cell_ids[index]);
+        });
+        profile::AddCounter("partition.customized_cells", cell_ids.size());
+    }
+
+    template <typename Weight>
+    void PartitionRouter<Weight>::CustomizeCell(uint32_t cell_id) {
+        Cell& cell = cells_[cell_id];
+        cell.distances.assign(cell.entries.size() * cell.exits.size(), std::nullopt);
+        CellWorkspace& workspace = GetCellWorkspace(cell.vertices.size());
+        for (size_t i = 0; i < cell.entries.size(); ++i) {
+            SearchCell(cell_id, cell.entries[i], workspace);
+            for (size_t j = 0; j < cell.exits.size(); ++j) {
+                const uint32_t local_exit = local_index_[cell.exits[j]];
+                if (workspace.IsReached(local_exit)) {
+                    cell.distances[i * cell.exits.size() + j] = workspace.distance[local_exit];
+                }
+            }
+        }
+    }
+
+    template <typename Weight>
+    void PartitionRouter<Weight>::SearchCell(uint32_t cell_id, VertexId source, CellWorkspace& workspace) const {
+        const Cell& cell = cells_[cell_id];
+        const uint64_t mark = ++workspace.search_mark;
+        auto& queue = workspace.queue;
+        queue.clear();
+
+        auto reach = [&](uint32_t local_vertex, Weight distance, EdgeId edge_id) {
+            workspace.reached_mark[local_vertex] = mark;
+            workspace.distance[local_vertex] = distance;
+            workspace.prev_edge[local_vertex] = edge_id;
+            queue.emplace_back(distance, local_vertex);
+            std::push_heap(queue.begin(), queue.end(), std::greater<>{});
+        };
+
+        reach(local_index_[source], Weight{}, NO_EDGE);
+        while (!queue.empty()) {
+            std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+            const auto [distance, local_vertex] = queue.back();
+            queue.pop_back();
+            if (distance > workspace.distance[local_vertex]) {
+                continue;
+            }
+            for (const EdgeId edge_id : graph_.GetIncidentEdges(cell.vertices[local_vertex])) {
+                const auto& edge = graph_.GetEdge(edge_id);
+                if (cell_of_[edge.to] != cell_id) {
+                    continue;
+                }
+                const uint32_t local_to = local_index_[edge.to];
+                const Weight candidate = distance + edge.weight;
+                if (!workspace.IsReached(local_to) || candidate < workspace.distance[local_to]) {
+                    reach(local_to, candidate, edge_id);
+                }
+            }
+        }
+    }
+
+    template <typename Weight>
+    void PartitionRouter<Weight>::UnpackCellPath(VertexId entry, VertexId exit, std::vector<EdgeId>& edges) const {
+        const uint32_t cell_id = cell_of_[exit];
+        CellWorkspace& workspace = GetCellWorkspace(cells_[cell_id].vertices.size());
+        SearchCell(cell_id, entry, workspace);
+        for (EdgeId edge_id = workspace.prev_edge[local_index_[exit]]; edge_id != NO_EDGE;
+            edge_id = workspace.prev_edge[local_index_[graph_.GetEdge(edge_id).from]]) {
+            edges.push_back(edge_id);
+        }
+    }
+
+    template <typename Weight>
+    bool PartitionRouter<Weight>::BuildRoute(VertexId from, VertexId to, RouteInfo<Weight>& route) const {
+        QueryWorkspace& workspace = GetQueryWorkspace(graph_.GetVertexCount());
+        const uint64_t mark = ++workspace.search_mark;
+        auto& queue = workspace.queue;
+        queue.clear();
+
+        auto reach = [&](VertexId vertex, Weight distance, EdgeId edge_id, VertexId prev_vertex) {
+            workspace.reached_mark[vertex] = mark;
+            workspace.distance[vertex] = distance;
+            workspace.prev_edge[vertex] = edge_id;
+            workspace.prev_vertex[vertex] = prev_vertex;
+            queue.emplace_back(distance, vertex);
+            std::push_heap(queue.begin(), queue.end(), std::greater<>{});
+        };
+        auto relax_edge = [&](VertexId vertex, Weight distance, EdgeId edge_id) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            const Weight candidate = distance + edge.weight;
+            if (workspace.reached_mark[edge.to] != mark || candidate < workspace.distance[edge.to]) {
+                reach(edge.to, candidate, edge_id, vertex);
+            }
+        };
+
+        const uint32_t from_cell = cell_of_[from];
+        const uint32_t to_cell = cell_of_[to];
+        reach(from, Weight{}, NO_EDGE, from);
+        bool found = false;
+        while (!queue.empty()) {
+            std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+            const auto [distance, vertex] = queue.back();
+            queue.pop_back();
+            if (distance > workspace.distance[vertex]) {
+                continue;
+            }
+            if (vertex == to) {
+                found = true;
+                break;
+            }
+
+            const uint32_t cell_id = cell_of_[vertex];
+            if (cell_id == from_cell || cell_id == to_cell) {
+                for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                    relax_edge(vertex, distance, edge_id);
+                }
+                continue;
+            }
+
+            // В чужую ячейку поиск попадает только через вход, а покидает её только через выход
+            for (size_t i = cut_edge_offsets_[vertex]; i < cut_edge_offsets_[vertex + 1]; ++i) {
+                relax_edge(vertex, distance, cut_edges_[i]);
+            }
+            if (const uint32_t entry = entry_index_[vertex]; entry != NO_INDEX) {
+                const Cell& cell = cells_[cell_id];
+                const auto* distances = cell.distances.data() + entry * cell.exits.size();
+                for (size_t j = 0; j < cell.exits.size(); ++j) {
+                    const VertexId exit = cell.exits[j];
+                    if (!distances[j] || exit == vertex) {
+                        continue;
+                    }
+                    const Weight candidate = distance + *distances[j];
+                    if (workspace.reached_mark[exit] != mark || candidate < workspace.distance[exit]) {
+                        reach(exit, candidate, NO_EDGE, vertex);
+                    }
+                }
+            }
+        }
+        if (!found) {
+            return false;
+        }
+
+        route.edges.clear();
+        for (VertexId vertex = to; vertex != from;) {
+            if (const EdgeId edge_id = workspace.prev_edge[vertex]; edge_id != NO_EDGE) {
+                route.edges.push_back(edge_id);
+                vertex = graph_.GetEdge(edge_id).from;
+            }
+            else {
+                UnpackCellPath(workspace.prev_vertex[vertex], vertex, route.edges);
+                vertex = workspace.prev_vertex[vertex];
+            }
+        }
+        std::reverse(route.edges.begin(), route.edges.end());
+
+        // Вес складывается по рёбрам в порядке следования, как при обычном поиске
+        route.weight = Weight{};
+        for (const EdgeId edge_id : route.edges) {
+            route.weight += graph_.GetEdge(edge_id).weight;
+        }
+        return true;
+    }
+
+    template <typename Weight>
+    void PartitionRouter<Weight>::UpdateEdgeWeights(const std::vector<EdgeId>& changed_edges, size_t thread_count) {
+        std::vector<bool> is_changed(cells_.size(), false);
+        std::vector<uint32_t> cell_ids;
+        for (const EdgeId edge_id : changed_edges) {
+            const auto& edge = graph_.GetEdge(edge_id);
+            const uint32_t cell_id = cell_of_[edge.from];
+            // Рёбра между ячейками читаются из графа при каждом запросе
+            if (cell_id == cell_of_[edge.to] && !is_changed[cell_id]) {
+                is_changed[cell_id] = true;
+                cell_ids.push_back(cell_id);
+            }
+        }
+        Customize(cell_ids, thread_count);
+    }
+
+    template <typename Weight>
+    memory_stats::Report PartitionRouter<Weight>::MemoryStats() const {
+        size_t cells = memory_stats::HeapBytes(cells_);
+        size_t distances = 0;
+        for (const Cell& cell : cells_) {
+            cells += memory_stats::HeapBytes(cell.vertices) + memory_stats::HeapBytes(cell.entries)
+                + memory_stats::HeapBytes(cell.exits);
+            distances += memory_stats::HeapBytes(cell.distances);
+        }
+        return {
+            { "partition_vertices", memory_stats::HeapBytes(cell_of_) + memory_stats::HeapBytes(local_index_)
+                + memory_stats::HeapBytes(entry_index_) },
+            { "partition_cut_edges", memory_stats::HeapBytes(cut_edge_offsets_) + memory_stats::HeapBytes(cut_edges_) },
+            { "partition_cells", cells },
+            { "partition_distances", distances },
+            { "search_workspace_per_thread", EstimateWorkspaceMemory(graph_.GetVertexCount()) },
+        };
+    }
+
+}  // namespace graph
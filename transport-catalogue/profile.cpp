@@ -0,0 +1,336 @@
+#include "profile.h"
+#include "json.h"
+#include "json_builder.h"
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
+// Размер выделенного блока нужен, чтобы при освобождении уменьшить счётчик занятой памяти
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define PROFILE_ALLOCATION_SIZE(ptr) malloc_usable_size(ptr)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define PROFILE_ALLOCATION_SIZE(ptr) malloc_size(ptr)
+#endif
+
+namespace profile {
+
+    using namespace std::literals;
+
+    namespace {
+        struct PhaseStats {
+            uint64_t count = 0;
+            uint64_t wall_ns = 0;
+            uint64_t cpu_ns = 0;
+        };
+
+        // Корзина k содержит задержки из [2^(k-1), 2^k) микросекунд, корзина 0 — задержки меньше микросекунды
+        struct LatencyHistogram {
+            static constexpr size_t BUCKET_COUNT = 40;
+
+            std::array<uint64_t, BUCKET_COUNT> buckets{};
+            uint64_t count = 0;
+            uint64_t total_ns = 0;
+            uint64_t max_ns = 0;
+
+            void Add(uint64_t ns) {
+                uint64_t us = ns / 1000;
+                size_t bucket = 0;
+                while (us > 0 && bucket + 1 < BUCKET_COUNT) {
+                    us >>= 1;
+                    ++bucket;
+                }
+                ++buckets[bucket];
+                ++count;
+                total_ns += ns;
+                max_ns = std::max(max_ns, ns);
+            }
+        };
+
+        struct Registry {
+            std::mutex mutex;
+            std::string report_path;
+            std::map<std::string, PhaseStats, std::less<>> phases;
+            std::map<std::string, uint64_t, std::less<>> counters;
+            std::map<std::string, LatencyHistogram, std::less<>> latencies;
+        };
+
+        // Счётчики выделений живут в статической памяти и обновляются атомарно:
+        // operator new не может ни выделять память, ни брать блокировки
+        struct AllocationCounters {
+            std::atomic<uint64_t> count;
+            std::atomic<uint64_t> bytes;
+            std::atomic<uint64_t> frees;
+            std::atomic<int64_t> peak_live_bytes;
+        };
+
+        std::array<AllocationCounters, static_cast<size_t>(AllocationTag::COUNT)> allocation_counters;
+        std::atomic<int64_t> live_bytes;
+        std::atomic<int64_t> peak_live_bytes;
+
+        void UpdateMaximum(std::atomic<int64_t>& maximum, int64_t value) {
+            int64_t current = maximum.load(std::memory_order_relaxed);
+            while (value > current && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        void RecordAllocation(void* ptr, size_t size) {
+            AllocationCounters& counters = allocation_counters[static_cast<size_t>(detail::allocation_tag)];
+            counters.count.fetch_add(1, std::memory_order_relaxed);
+            counters.bytes.fetch_add(size, std::memory_order_relaxed);
+#ifdef PROFILE_ALLOCATION_SIZE
+            const int64_t block_size = static_cast<int64_t>(PROFILE_ALLOCATION_SIZE(ptr));
+            const int64_t live = live_bytes.fetch_add(block_size, std::memory_order_relaxed) + block_size;
+            UpdateMaximum(counters.peak_live_bytes, live);
+            UpdateMaximum(peak_live_bytes, live);
+#else
+            (void)ptr;
+#endif
+        }
+
+        void RecordFree(void* ptr) {
+            allocation_counters[static_cast<size_t>(detail::allocation_tag)].frees.fetch_add(1, std::memory_order_relaxed);
+#ifdef PROFILE_ALLOCATION_SIZE
+            live_bytes.fetch_sub(static_cast<int64_t>(PROFILE_ALLOCATION_SIZE(ptr)), std::memory_order_relaxed);
+#else
+            (void)ptr;
+#endif
+        }
+
+        std::string_view GetTagName(AllocationTag tag) {
+            switch (tag) {
+            case AllocationTag::PARSE:  return "parse"sv;
+            case AllocationTag::INGEST: return "ingest"sv;
+            case AllocationTag::GRAPH:  return "graph"sv;
+            case AllocationTag::ROUTER: return "router"sv;
+            case AllocationTag::STATS:  return "stats"sv;
+            case AllocationTag::RENDER: return "render"sv;
+            case AllocationTag::PRINT:  return "print"sv;
+            default:                    return "other"sv;
+            }
+        }
+
+        Registry& GetRegistry() {
+            static Registry registry;
+            return registry;
+        }
+
+        // Большие значения не помещаются в int узла JSON и выводятся как double
+        json::Node::Value ToValue(uint64_t value) {
+            if (value <= static_cast<uint64_t>(INT_MAX)) {
+                return static_cast<int>(value);
+            }
+            return static_cast<double>(value);
+        }
+
+        double ToMilliseconds(uint64_t ns) {
+            return static_cast<double>(ns) / 1e6;
+        }
+
+        json::Node BuildReport(const Registry& registry) {
+            json::Builder builder;
+            builder.StartDict();
+            if (detail::allocations_enabled) {
+                // Пик занятой памяти этапа — наибольший объём памяти процесса при выделении внутри этапа,
+                // считая от включения подсчёта
+#ifdef PROFILE_ALLOCATION_SIZE
+                builder.Key("peak_live_bytes"s).Value(ToValue(static_cast<uint64_t>(std::max<int64_t>(0, peak_live_bytes))));
+#endif
+                builder.Key("allocations"s).StartDict();
+                for (size_t tag = 0; tag < allocation_counters.size(); ++tag) {
+                    const AllocationCounters& counters = allocation_counters[tag];
+                    if (counters.count == 0 && counters.frees == 0) {
+                        continue;
+                    }
+                    builder.Key(std::string(GetTagName(static_cast<AllocationTag>(tag)))).StartDict()
+                        .Key("count"s).Value(ToValue(counters.count))
+                        .Key("bytes"s).Value(ToValue(counters.bytes))
+                        .Key("frees"s).Value(ToValue(counters.frees));
+#ifdef PROFILE_ALLOCATION_SIZE
+                    builder.Key("peak_live_bytes"s).Value(ToValue(static_cast<uint64_t>(std::max<int64_t>(0, counters.peak_live_bytes))));
+#endif
+                    builder.EndDict();
+                }
+                builder.EndDict();
+            }
+
+            builder.Key("phases"s).StartDict();
+            for (const auto& [name, stats] : registry.phases) {
+                builder.Key(name).StartDict()
+                    .Key("count"s).Value(ToValue(stats.count))
+                    .Key("wall_ms"s).Value(ToMilliseconds(stats.wall_ns))
+                    .Key("cpu_ms"s).Value(ToMilliseconds(stats.cpu_ns))
+                    .EndDict();
+            }
+            builder.EndDict();
+
+            builder.Key("counters"s).StartDict();
+            for (const auto& [name, value] : registry.counters) {
+                builder.Key(name).Value(ToValue(value));
+            }
+            builder.EndDict();
+
+            builder.Key("latency"s).StartDict();
+            for (const auto& [name, histogram] : registry.latencies) {
+                builder.Key(name).StartDict()
+                    .Key("count"s).Value(ToValue(histogram.count))
+                    .Key("mean_us"s).Value(static_cast<double>(histogram.total_ns) / 1e3 / static_cast<double>(histogram.count))
+                    .Key("max_us"s).Value(static_cast<double>(histogram.max_ns) / 1e3)
+                    .Key("histogram"s).StartArray();
+                for (size_t bucket = 0; bucket < histogram.buckets.size(); ++bucket) {
+                    if (histogram.buckets[bucket] > 0) {
+                        builder.StartDict()
+                            .Key("below_us"s).Value(ToValue(uint64_t{ 1 } << bucket))
+                            .Key("count"s).Value(ToValue(histogram.buckets[bucket]))
+                            .EndDict();
+                    }
+                }
+                builder.EndArray().EndDict();
+            }
+            builder.EndDict();
+
+            return builder.EndDict().Build();
+        }
+    }
+
+    void Enable(std::string report_path) {
+        Registry& registry = GetRegistry();
+        {
+            std::lock_guard guard(registry.mutex);
+            registry.report_path = std::move(report_path);
+        }
+        detail::enabled = true;
+    }
+
+    void EnableFromEnvironment() {
+        const char* value = std::getenv("TC_PROFILE");
+        if (value == nullptr || *value == '\0') {
+            return;
+        }
+        const std::string_view setting = value;
+        Enable(setting == "1"sv || setting == "stderr"sv ? std::string{} : std::string(setting));
+    }
+
+    void EnableAllocationTracking() {
+        if (!IsEnabled()) {
+            Enable();
+        }
+        detail::allocations_enabled = true;
+    }
+
+    void EnableAllocationTrackingFromEnvironment() {
+        const char* value = std::getenv("TC_PROFILE_ALLOCATIONS");
+        if (value != nullptr && *value != '\0' && value != "0"sv) {
+            EnableAllocationTracking();
+        }
+    }
+
+    void AddCounter(std::string_view name, uint64_t value) {
+        if (!IsEnabled()) {
+            return;
+        }
+        Registry& registry = GetRegistry();
+        std::lock_guard guard(registry.mutex);
+        auto it = registry.counters.find(name);
+        if (it == registry.counters.end()) {
+            it = registry.counters.emplace(std::string(name), 0).first;
+        }
+        it->second += value;
+    }
+
+    void WriteReport() {
+        if (!IsEnabled()) {
+            return;
+        }
+
+        Registry& registry = GetRegistry();
+        std::lock_guard guard(registry.mutex);
+        const json::Document report(BuildReport(registry));
+        if (registry.report_path.empty()) {
+            json::Print(report, std::cerr);
+            std::cerr << std::endl;
+            return;
+        }
+
+        std::ofstream out(registry.report_path);
+        if (!out) {
+            throw std::runtime_error("Failed to open profile report file "s + registry.report_path);
+        }
+        json::Print(report, out);
+        out << '\n';
+    }
+
+    ScopedPhase::ScopedPhase(std::string_view name, AllocationTag tag, Kind kind)
+        : active_(IsEnabled())
+        , kind_(kind)
+        , previous_tag_(detail::allocation_tag)
+    {
+        if (!active_) {
+            return;
+        }
+        detail::allocation_tag = tag;
+        name_ = name;
+        wall_start_ = std::chrono::steady_clock::now();
+        cpu_start_ = std::clock();
+    }
+
+    ScopedPhase::~ScopedPhase() {
+        if (!active_) {
+            return;
+        }
+        detail::allocation_tag = previous_tag_;
+
+        // Процессорное время общее для процесса: у фаз, идущих одновременно в разных потоках, оно пересекается
+        const uint64_t wall_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - wall_start_).count());
+        const uint64_t cpu_ns = static_cast<uint64_t>(
+            static_cast<double>(std::clock() - cpu_start_) * 1e9 / CLOCKS_PER_SEC);
+
+        Registry& registry = GetRegistry();
+        std::lock_guard guard(registry.mutex);
+
+        const std::string phase = kind_ == Kind::REQUEST ? "stat_request."s + name_ : name_;
+        PhaseStats& stats = registry.phases[phase];
+        ++stats.count;
+        stats.wall_ns += wall_ns;
+        stats.cpu_ns += cpu_ns;
+
+        if (kind_ == Kind::REQUEST) {
+            registry.latencies[name_].Add(wall_ns);
+        }
+    }
+
+}  // namespace profile
+
+// Замена глобальных operator new и delete; пока подсчёт выключен, к malloc и free добавляется одна проверка флага.
+// Остальные формы (массивы, nothrow, sized) по умолчанию вызывают эти
+void* operator new(std::size_t size) {
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    if (profile::detail::allocations_enabled.load(std::memory_order_relaxed)) {
+        profile::RecordAllocation(ptr, size);
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr != nullptr && profile::detail::allocations_enabled.load(std::memory_order_relaxed)) {
+        profile::RecordFree(ptr);
+    }
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    ::operator delete(ptr);
+}
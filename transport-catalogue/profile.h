@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+/*
+ * Встроенная статистика по фазам обработки: время (настенное и процессорное), счётчики
+ * и гистограммы задержек stat-запросов по типам. По умолчанию выключена и почти ничего не стоит:
+ * каждый замер начинается с проверки одного атомарного флага.
+ * Отчёт в формате JSON пишется в stderr или в файл и никак не затрагивает stdout
+ */
+namespace profile {
+
+    // Этапы, по которым распределяются выделения памяти
+    enum class AllocationTag : uint8_t {
+        OTHER,
+        PARSE,
+        INGEST,
+        GRAPH,
+        ROUTER,
+        STATS,
+        RENDER,
+        PRINT,
+        COUNT,
+    };
+
+    namespace detail {
+        inline std::atomic<bool> enabled{ false };
+        inline std::atomic<bool> allocations_enabled{ false };
+        inline thread_local AllocationTag allocation_tag = AllocationTag::OTHER;
+    }
+
+    inline bool IsEnabled() {
+        return detail::enabled.load(std::memory_order_relaxed);
+    }
+
+    // Включает сбор статистики; отчёт пишется в файл report_path, а при пустом пути — в stderr
+    void Enable(std::string report_path = {});
+
+    // Включает сбор, если задана переменная окружения TC_PROFILE:
+    // значения "1" и "stderr" направляют отчёт в stderr, любое другое считается путём к файлу
+    void EnableFromEnvironment();
+
+    // Включает подсчёт выделений памяти (вместе со сбором статистики): глобальные operator new и delete
+    // считают по этапам число выделений, байты и пик занятой памяти. Память, выделенная до включения, не учитывается
+    void EnableAllocationTracking();
+
+    // Включает подсчёт выделений, если задана переменная окружения TC_PROFILE_ALLOCATIONS
+    void EnableAllocationTrackingFromEnvironment();
+
+    inline AllocationTag GetAllocationTag() {
+        return detail::allocation_tag;
+    }
+
+    // Относит выделения памяти в текущем потоке к этапу tag до разрушения объекта.
+    // Новые потоки начинают с OTHER, поэтому этап передаётся в них явно (см. parallel::ForEachIndex)
+    class ScopedAllocationTag {
+    public:
+        explicit ScopedAllocationTag(AllocationTag tag)
+            : previous_(detail::allocation_tag) {
+            detail::allocation_tag = tag;
+        }
+
+        ~ScopedAllocationTag() {
+            detail::allocation_tag = previous_;
+        }
+
+        ScopedAllocationTag(const ScopedAllocationTag&) = delete;
+        ScopedAllocationTag& operator=(const ScopedAllocationTag&) = delete;
+
+    private:
+        const AllocationTag previous_;
+    };
+
+    // Прибавляет value к счётчику name
+    void AddCounter(std::string_view name, uint64_t value);
+
+    // Записывает отчёт о собранной статистике, если сбор включён.
+    // Выбрасывает std::runtime_error, если файл отчёта не удалось открыть
+    void WriteReport();
+
+    /*
+     * Замер фазы от создания объекта до его разрушения; выделения памяти внутри фазы относятся к этапу tag.
+     * Фаза REQUEST — ответ на stat-запрос типа name: время попадает в фазу "stat_request.<name>"
+     * и дополнительно в гистограмму задержек этого типа запросов
+     */
+    class ScopedPhase {
+    public:
+        enum class Kind {
+            PHASE,
+            REQUEST,
+        };
+
+        ScopedPhase(std::string_view name, AllocationTag tag, Kind kind = Kind::PHASE);
+        ~ScopedPhase();
+
+        ScopedPhase(const ScopedPhase&) = delete;
+        ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+    private:
+        const bool active_;
+        const Kind kind_;
+        const AllocationTag previous_tag_;
+        std::string name_;
+        std::chrono::steady_clock::time_point wall_start_;
+        std::clock_t cpu_start_ = 0;
+    };
+
+    // Буфер потока, передающий вывод в другой буфер и считающий записанные байты
+    class CountingStreamBuf : public std::streambuf {
+    public:
+        explicit CountingStreamBuf(std::streambuf* target)
+            : target_(target) {
+        }
+
+        uint64_t GetCount() const {
+            return count_;
+        }
+
+    protected:
+        int_type overflow(int_type ch) override {
+            if (traits_type::eq_int_type(ch, traits_type::eof())) {
+                return traits_type::not_eof(ch);
+            }
+            ++count_;
+            return target_->sputc(traits_type::to_char_type(ch));
+        }
+
+        std::streamsize xsputn(const char* data, std::streamsize size) override {
+            const std::streamsize written = target_->sputn(data, size);
+            count_ += static_cast<uint64_t>(written);
+            return written;
+        }
+
+        int sync() override {
+            return target_->pubsync();
+        }
+
+    private:
+        std::streambuf* target_;
+        uint64_t count_ = 0;
+    };
+
+}  // namespace profile
@@ -0,0 +1,360 @@
+#include "query_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define QUERY_SERVER_UNIX_SOCKETS
+#endif
+
+namespace query_server {
+
+    using namespace std::literals;
+
+    namespace {
+        std::string_view TrimLine(std::string_view line) {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) {
+                line.remove_suffix(1);
+            }
+            while (!line.empty() && (line.front() == ' ' || line.front() == '\t')) {
+                line.remove_prefix(1);
+            }
+            return line;
+        }
+
+        std::string ErrorLine(const json::Dict* request, const std::string& message) {
+            json::Dict error{ {"error_message"s, message} };
+            if (request) {
+                if (auto it_id = request->find("id"s); it_id != request->end() && it_id->second.IsInt()) {
+                    error.emplace("request_id"s, it_id->second.AsInt());
+                }
+            }
+
+            std::ostringstream out;
+            json::PrintCompact(json::Document(std::move(error)), out);
+            return out.str();
+        }
+    }
+
+    std::string QueryServer::AnswerLine(std::string_view line) {
+        std::istringstream input{ std::string(line) };
+
+        json::Document document{ nullptr };
+        try {
+            document = json::Load(input);
+        }
+        catch (const std::exception& e) {
+            return ErrorLine(nullptr, "Invalid JSON: "s + e.what());
+        }
+
+        const json::Node& request = document.GetRoot();
+        if (!request.IsDict()) {
+            return ErrorLine(nullptr, "Request must be a dictionary"s);
+        }
+
+        try {
+            std::ostringstream out;
+            json::PrintCompact(json::Document(reader_.AnswerStatRequest(request.AsDict(), tc_, rh_, tr_)), out);
+            return out.str();
+        }
+        catch (const std::exception& e) {
+            return ErrorLine(&request.AsDict(), e.what());
+        }
+    }
+
+    void QueryServer::Serve(std::istream& input, std::ostream& output) {
+        for (std::string line; std::getline(input, line);) {
+            const std::string_view request = TrimLine(line);
+            if (request.empty()) {
+                continue;
+            }
+            output << AnswerLine(request) << '\n' << std::flush;
+        }
+    }
+
+#ifdef QUERY_SERVER_UNIX_SOCKETS
+    namespace {
+        bool WriteAll(int fd, std::string_view data) {
+#ifdef MSG_NOSIGNAL
+            constexpr int flags = MSG_NOSIGNAL;
+#else
+            constexpr int flags = 0;
+#endif
+            while (!data.empty()) {
+                const ssize_t written = send(fd, data.data(), data.size(), flags);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written <= 0) {
+                    return false;
+                }
+                data.remove_prefix(static_cast<size_t>(written));
+            }
+            return true;
+        }
+
+        /*
+         * Потоки, обслуживающие соединения: одновременно не больше max_count, при нехватке места Start ждёт
+         * завершения одного из них. Дескриптор соединения закрывается после обслуживания. Деструктор
+         * обрывает незавершённые соединения и дожидается всех потоков, поэтому ссылки, которые держат потоки,
+         * остаются действительными до конца их работы
+         */
+        class ConnectionWorkers {
+        public:
+            explicit ConnectionWorkers(size_t max_count)
+                : max_count_(std::max<size_t>(1, max_count)) {
+            }
+
+            ConnectionWorkers(const ConnectionWorkers&) = delete;
+            ConnectionWorkers& operator=(const ConnectionWorkers&) = delete;
+
+            ~ConnectionWorkers() {
+                {
+                    std::lock_guard guard(mutex_);
+                    for (const Worker& worker : workers_) {
+                        if (!worker.finished) {
+                            shutdown(worker.fd, SHUT_RDWR);
+                        }
+                    }
+                }
+                // Потоки только отмечают завершение и не меняют список, поэтому его можно обходить без блокировки
+                for (Worker& worker : workers_) {
+                    worker.thread.join();
+                }
+            }
+
+            template <typename Func>
+            void Start(int fd, Func serve) {
+                std::unique_lock lock(mutex_);
+                worker_finished_.wait(lock, [this]() {
+                    JoinFinished();
+                    return workers_.size() < max_count_;
+                });
+
+                auto worker = workers_.emplace(workers_.end());
+                worker->fd = fd;
+                worker->thread = std::thread([this, worker, fd, serve]() {
+                    serve(fd);
+                    std::lock_guard guard(mutex_);
+                    close(fd);
+                    worker->finished = true;
+                    worker_finished_.notify_one();
+                });
+            }
+
+        private:
+            struct Worker {
+                std::thread thread;
+                int fd = -1;
+                bool finished = false;
+            };
+
+            // Вызывается под блокировкой
+            void JoinFinished() {
+                for (auto it = workers_.begin(); it != workers_.end();) {
+                    if (it->finished) {
+                        it->thread.join();
+                        it = workers_.erase(it);
+                    }
+                    else {
+                        ++it;
+                    }
+                }
+            }
+
+            const size_t max_count_;
+            std::mutex mutex_;
+            std::condition_variable worker_finished_;
+            std::list<Worker> workers_;
+        };
+
+        volatile std::sig_atomic_t shutdown_requested = 0;
+
+        void RequestShutdown(int) {
+            shutdown_requested = 1;
+        }
+
+        // Пока объект жив, SIGINT и SIGTERM не завершают процесс, а только просят сервер остановиться
+        class ShutdownSignals {
+        public:
+            ShutdownSignals() {
+                shutdown_requested = 0;
+                struct sigaction action {};
+                action.sa_handler = RequestShutdown;
+                sigemptyset(&action.sa_mask);
+                sigaction(SIGINT, &action, &previous_int_);
+                sigaction(SIGTERM, &action, &previous_term_);
+            }
+
+            ShutdownSignals(const ShutdownSignals&) = delete;
+            ShutdownSignals& operator=(const ShutdownSignals&) = delete;
+
+            ~ShutdownSignals() {
+                sigaction(SIGINT, &previous_int_, nullptr);
+                sigaction(SIGTERM, &previous_term_, nullptr);
+            }
+
+            bool IsRequested() const {
+                return shutdown_requested != 0;
+            }
+
+        private:
+            struct sigaction previous_int_ {};
+            struct sigaction previous_term_ {};
+        };
+
+        // Слушающий сокет: закрывается, а его файл удаляется при любом выходе из ServeUnixSocket
+        class ListeningSocket {
+        public:
+            ListeningSocket(int fd, std::string path)
+                : fd_(fd)
+                , path_(std::move(path)) {
+            }
+
+            ListeningSocket(const ListeningSocket&) = delete;
+            ListeningSocket& operator=(const ListeningSocket&) = delete;
+
+            ~ListeningSocket() {
+                close(fd_);
+                unlink(path_.c_str());
+            }
+
+            int GetFd() const {
+                return fd_;
+            }
+
+        private:
+            const int fd_;
+            const std::string path_;
+        };
+
+        // Сигнал может прийти между проверкой флага и ожиданием соединения: тогда его заметят по истечении таймаута
+        constexpr int ACCEPT_POLL_TIMEOUT_MS = 200;
+
+        // Ошибки accept, после которых можно принимать соединения дальше
+        bool IsTransientAcceptError(int error) {
+            return error == EINTR || error == ECONNABORTED || error == EMFILE || error == ENFILE
+                || error == ENOBUFS || error == ENOMEM;
+        }
+    }
+
+    void QueryServer::ServeUnixSocket(const std::string& socket_path, size_t max_connections) {
+        sockaddr_un address{};
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Socket path is too long: "s + socket_path);
+        }
+        address.sun_family = AF_UNIX;
+        socket_path.copy(address.sun_path, socket_path.size());
+
+        // Удаляется только оставшийся от прошлого запуска сокет, а не любой файл по этому пути
+        struct stat path_info{};
+        if (lstat(socket_path.c_str(), &path_info) == 0) {
+            if (!S_ISSOCK(path_info.st_mode)) {
+                throw std::runtime_error("Socket path exists and is not a socket: "s + socket_path);
+            }
+            unlink(socket_path.c_str());
+        }
+
+        const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            throw std::runtime_error("Failed to create socket"s);
+        }
+
+        if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+            close(listen_fd);
+            throw std::runtime_error("Failed to bind socket "s + socket_path);
+        }
+        const ListeningSocket listening(listen_fd, socket_path);
+        if (listen(listen_fd, SOMAXCONN) < 0) {
+            throw std::runtime_error("Failed to listen on socket "s + socket_path);
+        }
+
+        // Объявлены после listening: соединения завершаются раньше, чем закрывается слушающий сокет
+        const ShutdownSignals signals;
+        ConnectionWorkers workers(max_connections);
+        while (!signals.IsRequested()) {
+            pollfd listen_poll{ listen_fd, POLLIN, 0 };
+            const int ready = poll(&listen_poll, 1, ACCEPT_POLL_TIMEOUT_MS);
+            if (ready < 0 && errno != EINTR) {
+                throw std::runtime_error("Failed to wait for connections on socket "s + socket_path);
+            }
+            if (ready <= 0) {
+                continue;
+            }
+
+            const int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                const int error = errno;
+                if (error == EINTR || error == ECONNABORTED) {
+                    continue;
+                }
+                if (IsTransientAcceptError(error)) {
+                    // Не хватает дескрипторов или памяти: ждём, пока освободятся
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    continue;
+                }
+                throw std::runtime_error("Failed to accept connection on socket "s + socket_path);
+            }
+            workers.Start(fd, [this](int connection_fd) { ServeConnection(connection_fd); });
+        }
+    }
+
+    void QueryServer::ServeConnection(int fd) {
+        std::string buffer;
+        char chunk[4096];
+
+        while (true) {
+            const ssize_t received = read(fd, chunk, sizeof(chunk));
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                break;
+            }
+            buffer.append(chunk, static_cast<size_t>(received));
+
+            size_t line_begin = 0;
+            for (size_t line_end; (line_end = buffer.find('\n', line_begin)) != std::string::npos; line_begin = line_end + 1) {
+                if (line_end - line_begin > MAX_LINE_LENGTH) {
+                    WriteAll(fd, ErrorLine(nullptr, "Request line is too long"s) + '\n');
+                    return;
+                }
+                const std::string_view request = TrimLine(std::string_view(buffer).substr(line_begin, line_end - line_begin));
+                if (request.empty()) {
+                    continue;
+                }
+                if (!WriteAll(fd, AnswerLine(request) + '\n')) {
+                    return;
+                }
+            }
+            buffer.erase(0, line_begin);
+            // Без ограничения клиент, не присылающий перевода строки, занял бы всю память
+            if (buffer.size() > MAX_LINE_LENGTH) {
+                WriteAll(fd, ErrorLine(nullptr, "Request line is too long"s) + '\n');
+                return;
+            }
+        }
+    }
+#else
+    void QueryServer::ServeUnixSocket(const std::string&, size_t) {
+        throw std::logic_error("Unix domain sockets are not supported on this platform"s);
+    }
+
+    void QueryServer::ServeConnection(int) {
+    }
+#endif
+
+}  // namespace query_server
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "json_reader.h"
+#include "request_handler.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+#include <iostream>
+#include <string>
+#include <string_view>
+
+namespace query_server {
+
+    /*
+     * Долгоживущий сервер запросов. Справочник, обработчик карты и маршрутизатор строятся один раз
+     * и переиспользуются: на каждую строку с одним stat-запросом (NDJSON) выдаётся ровно одна строка ответа.
+     * Методы можно вызывать из нескольких потоков одновременно: запросы, изменяющие маршрутизатор
+     * (SetVelocity, SetRoutingSettings), выполняются под его исключительной блокировкой и видны всем последующим запросам
+     */
+    class QueryServer {
+    public:
+        // Наибольшая длина строки запроса в соединении: на более длинную строку отвечаем ошибкой и закрываем соединение
+        static constexpr size_t MAX_LINE_LENGTH = 1 << 20;
+
+        QueryServer(const json_reader::JsonReader& reader,
+            const transport_catalogue::TransportCatalogue& tc,
+            const RequestHandler& rh,
+            graph::LazyTransportRouter<double>& tr)
+            : reader_(reader)
+            , tc_(tc)
+            , rh_(rh)
+            , tr_(tr)
+        {
+        }
+
+        // Отвечает на запрос из одной строки. Ошибки разбора и обработки не прерывают работу сервера,
+        // а возвращаются в ответе в поле "error_message"
+        std::string AnswerLine(std::string_view line);
+
+        // Обслуживает запросы из input до конца потока, пустые строки пропускаются
+        void Serve(std::istream& input, std::ostream& output);
+
+        // Принимает соединения на Unix domain socket, каждое соединение обслуживается в отдельном потоке,
+        // одновременно — не больше max_connections. Оставшийся по пути socket_path сокет заменяется, любой другой
+        // файл — нет (std::runtime_error). Временные ошибки accept (EINTR, ECONNABORTED, нехватка
+        // дескрипторов) не прерывают работу. По SIGINT или SIGTERM перестаёт принимать соединения и возвращает
+        // управление; при ошибке сокета выбрасывает std::runtime_error. В обоих случаях открытые соединения
+        // закрываются, их потоки завершаются, а файл сокета удаляется
+        void ServeUnixSocket(const std::string& socket_path, size_t max_connections = 64);
+
+    private:
+        // Обслуживает соединение до его закрытия; дескриптор закрывает вызывающий
+        void ServeConnection(int fd);
+
+        const json_reader::JsonReader& reader_;
+        const transport_catalogue::TransportCatalogue& tc_;
+        const RequestHandler& rh_;
+        graph::LazyTransportRouter<double>& tr_;
+    };
+
+}  // namespace query_server
@@ -1,15 +1,111 @@
 #include "request_handler.h"
 
-svg::Document RequestHandler::RenderMap() const {
-	std::deque<transport_catalogue::Bus> deque_bus = tc_.GetAllRoute();
+#include <sstream>
 
-	std::sort(deque_bus.begin(), deque_bus.end(),
-		[](const transport_catalogue::Bus& lhs, const transport_catalogue::Bus& rhs) {
-			return lhs.name < rhs.name;
+namespace {
+	std::vector<const transport_catalogue::Bus*> GetSortedBuses(const transport_catalogue::TransportCatalogue& tc) {
+		const auto& all_buses = tc.GetAllRoute();
+
+		std::vector<const transport_catalogue::Bus*> buses;
+		buses.reserve(all_buses.size());
+		for (const transport_catalogue::Bus& bus : all_buses) {
+			buses.push_back(&bus);
 		}
-	);
 
-	map_renderer::RenderMap rm(rs_, deque_bus);
+		std::sort(buses.begin(), buses.end(),
+			[](const transport_catalogue::Bus* lhs, const transport_catalogue::Bus* rhs) {
+				return lhs->name < rhs->name;
+			}
+		);
+
+		return buses;
+	}
+}
+
+void RequestHandler::RenderMap(std::ostream& out) const {
+	profile::ScopedPhase phase("render_map", profile::AllocationTag::RENDER);
+	map_renderer::RenderMap rm(rs_, GetSortedBuses(tc_));
+
+	rm.RenderAllLayers(out, render_thread_count_);
+}
+
+RequestHandler::MapCache& RequestHandler::GetMapCache() const {
+	if (!map_cache_ || map_cache_->catalogue_version != tc_.GetVersion() || map_cache_->render_settings != rs_) {
+		const size_t generation = map_cache_ ? map_cache_->generation + 1 : 0;
+		map_cache_ = MapCache{ generation, tc_.GetVersion(), rs_,
+			std::make_shared<const map_renderer::RenderMap>(rs_, GetSortedBuses(tc_)), nullptr };
+		tile_cache_.Clear();
+	}
+	return *map_cache_;
+}
+
+std::shared_ptr<const std::string> RequestHandler::GetMapSvg() const {
+	// Блокировка удерживается на время отрисовки, чтобы одновременные запросы не рисовали карту повторно
+	std::lock_guard guard(map_cache_mutex_);
+
+	MapCache& map_cache = GetMapCache();
+	EnsureMapSvg(map_cache);
+
+	return map_cache.svg;
+}
+
+void RequestHandler::EnsureMapSvg(MapCache& map_cache) const {
+	if (!map_cache.svg) {
+		profile::ScopedPhase phase("render_map", profile::AllocationTag::RENDER);
+		std::ostringstream out;
+		map_cache.render_map->RenderAllLayers(out, render_thread_count_);
+		map_cache.svg = std::make_shared<const std::string>(out.str());
+		profile::AddCounter("render.map_bytes", map_cache.svg->size());
+	}
+}
+
+std::string RequestHandler::GetRouteMapSvg(const std::vector<map_renderer::RouteLeg>& legs) const {
+	std::shared_ptr<const map_renderer::RenderMap> render_map;
+	std::shared_ptr<const std::string> base_svg;
+	{
+		std::lock_guard guard(map_cache_mutex_);
+		MapCache& map_cache = GetMapCache();
+		EnsureMapSvg(map_cache);
+		render_map = map_cache.render_map;
+		base_svg = map_cache.svg;
+	}
+
+	profile::ScopedPhase phase("render_route_overlay", profile::AllocationTag::RENDER);
+	std::ostringstream overlay;
+	render_map->RenderRouteOverlay(overlay, legs);
+	const std::string overlay_svg = overlay.str();
+
+	static const std::string_view closing_tag = "</svg>";
+	const size_t body_size = base_svg->size() - closing_tag.size();
+
+	std::string result;
+	result.reserve(base_svg->size() + overlay_svg.size());
+	result.append(*base_svg, 0, body_size);
+	result += overlay_svg;
+	result += closing_tag;
+	return result;
+}
+
+std::shared_ptr<const std::string> RequestHandler::GetMapTileSvg(const map_renderer::Viewport& viewport) const {
+	std::shared_ptr<const map_renderer::RenderMap> render_map;
+	TileKey key{ 0, viewport };
+	{
+		std::lock_guard guard(map_cache_mutex_);
+		const MapCache& map_cache = GetMapCache();
+		render_map = map_cache.render_map;
+		key.generation = map_cache.generation;
+	}
+
+	if (auto tile = tile_cache_.Get(key)) {
+		return *tile;
+	}
+
+	// Разные тайлы отрисовываются параллельно, без общей блокировки
+	profile::ScopedPhase phase("render_tile", profile::AllocationTag::RENDER);
+	std::ostringstream out;
+	render_map->RenderViewport(out, viewport);
+	auto tile = std::make_shared<const std::string>(out.str());
+	tile_cache_.Put(key, tile);
 
-	return rm.RenderAllLayers(tc_);
+	return tile;
 }
\ No newline at end of file
@@ -1,18 +1,81 @@
 #pragma once
 #include "transport_catalogue.h"
 #include "map_renderer.h"
+#include "lru_cache.h"
+#include "profile.h"
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
 
 class RequestHandler {
 public:
-    RequestHandler(const transport_catalogue::TransportCatalogue& tc, const map_renderer::RenderSettings& rs)
+    // render_thread_count — число потоков для отрисовки полной карты
+    RequestHandler(const transport_catalogue::TransportCatalogue& tc, const map_renderer::RenderSettings& rs,
+        size_t render_thread_count = 1, size_t tile_cache_capacity = 1024)
         : tc_(tc)
         , rs_(rs)
+        , render_thread_count_(render_thread_count)
+        , tile_cache_(tile_cache_capacity)
     {
     }
 
-    svg::Document RenderMap() const;
+    const map_renderer::RenderSettings& GetRenderSettings() const {
+        return rs_;
+    }
+
+    // Выводит карту в поток в формате SVG
+    void RenderMap(std::ostream& out) const;
+
+    // Возвращает карту в виде SVG-строки. Карта отрисовывается один раз и переиспользуется,
+    // пока не изменятся справочник (его версия) или настройки отрисовки
+    std::shared_ptr<const std::string> GetMapSvg() const;
+
+    // Возвращает часть карты, попадающую в область viewport. Готовые тайлы хранятся в LRU-кеше,
+    // который сбрасывается вместе с кешем карты
+    std::shared_ptr<const std::string> GetMapTileSvg(const map_renderer::Viewport& viewport) const;
+
+    // Возвращает карту с выделенным маршрутом поездки. Базовая карта берётся из кеша готовой строкой,
+    // отрисовываются только участки маршрута, которые вставляются перед закрывающим тегом
+    std::string GetRouteMapSvg(const std::vector<map_renderer::RouteLeg>& legs) const;
 
 private:
+    struct MapCache {
+        // Номер поколения кеша: тайлы, отрисованные по устаревшей карте, не попадут под новый ключ
+        size_t generation;
+        size_t catalogue_version;
+        map_renderer::RenderSettings render_settings;
+        std::shared_ptr<const map_renderer::RenderMap> render_map;
+        std::shared_ptr<const std::string> svg;
+    };
+
+    struct TileKey {
+        size_t generation;
+        map_renderer::Viewport viewport;
+
+        bool operator==(const TileKey& other) const {
+            return generation == other.generation && viewport == other.viewport;
+        }
+    };
+
+    struct TileKeyHash {
+        size_t operator()(const TileKey& key) const {
+            return map_renderer::ViewportHash{}(key.viewport) * 37 + key.generation;
+        }
+    };
+
+    // Возвращает актуальное состояние кеша; вызывается под map_cache_mutex_
+    MapCache& GetMapCache() const;
+    // Отрисовывает полную карту, если её ещё нет в кеше; вызывается под map_cache_mutex_
+    void EnsureMapSvg(MapCache& map_cache) const;
+
     const transport_catalogue::TransportCatalogue& tc_;
     const map_renderer::RenderSettings& rs_;
+    const size_t render_thread_count_;
+
+    mutable std::mutex map_cache_mutex_;
+    mutable std::optional<MapCache> map_cache_;
+    mutable cache::LruCache<TileKey, std::shared_ptr<const std::string>, TileKeyHash> tile_cache_;
 };
\ No newline at end of file
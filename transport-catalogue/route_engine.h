@@ -0,0 +1,43 @@
+#pragma once
+
+#include "graph.h"
+#include "memory_stats.h"
+
+#include <vector>
+
+namespace graph {
+
+    // Найденный маршрут: суммарный вес и рёбра в порядке следования
+    template <typename Weight>
+    struct RouteInfo {
+        Weight weight;
+        std::vector<EdgeId> edges;
+    };
+
+    /*
+     * Способ поиска кратчайших маршрутов в графе. Реализации различаются балансом между
+     * временем и памятью на подготовку и временем одного запроса.
+     * Константные методы потокобезопасны; UpdateEdgeWeights нельзя вызывать одновременно с ними
+     */
+    template <typename Weight>
+    class RouteEngine {
+    public:
+        virtual ~RouteEngine() = default;
+
+        // Записывает маршрут в route, переиспользуя память route.edges; возвращает false, если маршрута нет.
+        // Номера вершин не проверяются и должны быть меньше числа вершин графа
+        virtual bool BuildRoute(VertexId from, VertexId to, RouteInfo<Weight>& route) const = 0;
+
+        // Оценка памяти, которую занимают данные поиска
+        virtual memory_stats::Report MemoryStats() const = 0;
+
+        // Обновляет данные поиска после того, как в графе изменились веса рёбер changed_edges
+        virtual void UpdateEdgeWeights(const std::vector<EdgeId>& changed_edges, size_t thread_count) = 0;
+
+        // false, если пересчёт после изменения весов слишком дорог и веса рёбер менять нельзя
+        virtual bool SupportsWeightUpdates() const {
+            return true;
+        }
+    };
+
+}  // namespace graph
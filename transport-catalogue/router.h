@@ -1,10 +1,14 @@
 #pragma once
 
 #include "graph.h"
+#include "parallel.h"
+#include "profile.h"
+#include "route_engine.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <functional>
 #include <iterator>
 #include <optional>
 #include <stdexcept>
@@ -14,21 +18,43 @@
 
 namespace graph {
 
+    // Предрасчёт кратчайших маршрутов между всеми парами вершин (алгоритм Флойда — Уоршелла): запрос за O(длины маршрута)
     template <typename Weight>
-    class Router {
+    class Router final : public RouteEngine<Weight> {
     private:
         using Graph = DirectedWeightedGraph<Weight>;
 
     public:
         explicit Router(const Graph& graph);
 
-        struct RouteInfo {
-            Weight weight;
-            std::vector<EdgeId> edges;
-        };
+        using RouteInfo = graph::RouteInfo<Weight>;
 
         std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
 
+        bool BuildRoute(VertexId from, VertexId to, RouteInfo& route) const override;
+
+        /*
+         * Пересчитывает алгоритмом Дейкстры только строки матрицы (маршруты из одной вершины), которые
+         * могли измениться: дерево кратчайших путей строки проходит через изменённое ребро
+         * либо ребро стало короче пути в свой конец. Число пересчитанных строк — в счётчике router.repaired_rows
+         */
+        void UpdateEdgeWeights(const std::vector<EdgeId>& changed_edges, size_t thread_count) override;
+
+        // Оценка памяти матрицы кратчайших путей: она занимает V^2 ячеек
+        memory_stats::Report MemoryStats() const override {
+            size_t routes = memory_stats::HeapBytes(routes_internal_data_);
+            for (const auto& row : routes_internal_data_) {
+                routes += memory_stats::HeapBytes(row);
+            }
+            return { { "routes_internal_data", routes } };
+        }
+
+        // Сколько займёт матрица для графа из vertex_count вершин, без её построения
+        static size_t EstimateMemory(size_t vertex_count) {
+            return vertex_count * (sizeof(std::vector<std::optional<RouteInternalData>>)
+                + vertex_count * sizeof(std::optional<RouteInternalData>));
+        }
+
     private:
         struct RouteInternalData {
             Weight weight;
@@ -53,26 +79,60 @@ namespace graph {
             }
         }
 
-        void RelaxRoute(VertexId vertex_from, VertexId vertex_to, const RouteInternalData& route_from,
+        // Возвращает true, если маршрут удалось улучшить
+        bool RelaxRoute(VertexId vertex_from, VertexId vertex_to, const RouteInternalData& route_from,
             const RouteInternalData& route_to) {
             auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
             const Weight candidate_weight = route_from.weight + route_to.weight;
             if (!route_relaxing || candidate_weight < route_relaxing->weight) {
                 route_relaxing = { candidate_weight,
                                   route_to.prev_edge ? route_to.prev_edge : route_from.prev_edge };
+                return true;
             }
+            return false;
         }
 
-        void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
+        // Возвращает число улучшенных маршрутов
+        size_t RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
+            size_t relaxation_count = 0;
             for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
                 if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
                     for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
                         if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-                            RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
+                            relaxation_count += RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
                         }
                     }
                 }
             }
+            return relaxation_count;
+        }
+
+        // Строит строку матрицы заново по текущим весам рёбер
+        void RecomputeRow(VertexId vertex_from) {
+            auto& row = routes_internal_data_[vertex_from];
+            std::fill(row.begin(), row.end(), std::nullopt);
+            row[vertex_from] = RouteInternalData{ ZERO_WEIGHT, std::nullopt };
+
+            using QueueEntry = std::pair<Weight, VertexId>;
+            std::vector<QueueEntry> queue{ { ZERO_WEIGHT, vertex_from } };
+            while (!queue.empty()) {
+                std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+                const auto [weight, vertex] = queue.back();
+                queue.pop_back();
+                if (weight > row[vertex]->weight) {
+                    continue;
+                }
+                for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                    const auto& edge = graph_.GetEdge(edge_id);
+                    const Weight candidate = weight + edge.weight;
+                    auto& route = row[edge.to];
+                    if (!route || candidate < route->weight) {
+                        route = RouteInternalData{ candidate, edge_id };
+                        queue.emplace_back(candidate, edge.to);
+                        std::push_heap(queue.begin(), queue.end(), std::greater<>{});
+                    }
+                }
+            }
         }
 
         static constexpr Weight ZERO_WEIGHT{};
@@ -83,35 +143,75 @@ namespace graph {
     template <typename Weight>
     Router<Weight>::Router(const Graph& graph)
         : graph_(graph)
-        , routes_internal_data_(graph.GetVertexCount(),
-            std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
     {
+        profile::ScopedPhase phase("router_precompute", profile::AllocationTag::ROUTER);
+        routes_internal_data_.assign(graph.GetVertexCount(),
+            std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()));
         InitializeRoutesInternalData(graph);
 
         const size_t vertex_count = graph.GetVertexCount();
+        size_t relaxation_count = 0;
         for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
-            RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+            relaxation_count += RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
         }
+        profile::AddCounter("router.relaxations", relaxation_count);
     }
 
     template <typename Weight>
     std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from,
         VertexId to) const {
-        const auto& route_internal_data = routes_internal_data_.at(from).at(to);
-        if (!route_internal_data) {
+        if (from >= routes_internal_data_.size() || to >= routes_internal_data_.size()) {
+            throw std::out_of_range("Router: vertex id is out of range");
+        }
+        RouteInfo route;
+        if (!BuildRoute(from, to, route)) {
             return std::nullopt;
         }
-        const Weight weight = route_internal_data->weight;
-        std::vector<EdgeId> edges;
+        return route;
+    }
+
+    template <typename Weight>
+    void Router<Weight>::UpdateEdgeWeights(const std::vector<EdgeId>& changed_edges, size_t thread_count) {
+        const size_t vertex_count = routes_internal_data_.size();
+        std::vector<VertexId> affected_rows;
+        for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
+            const auto& row = routes_internal_data_[vertex_from];
+            const bool affected = std::any_of(changed_edges.begin(), changed_edges.end(), [&](EdgeId edge_id) {
+                const auto& edge = graph_.GetEdge(edge_id);
+                const auto& route_to = row[edge.to];
+                if (route_to && route_to->prev_edge == edge_id) {
+                    return true;
+                }
+                const auto& route_from = row[edge.from];
+                return route_from && (!route_to || route_from->weight + edge.weight < route_to->weight);
+            });
+            if (affected) {
+                affected_rows.push_back(vertex_from);
+            }
+        }
+
+        parallel::ForEachIndex(affected_rows.size(), thread_count, [&](size_t index) {
+            RecomputeRow(affected_rows[index]);
+        });
+        profile::AddCounter("router.repaired_rows", affected_rows.size());
+    }
+
+    template <typename Weight>
+    bool Router<Weight>::BuildRoute(VertexId from, VertexId to, RouteInfo& route) const {
+        const auto& route_internal_data = routes_internal_data_[from][to];
+        if (!route_internal_data) {
+            return false;
+        }
+        route.weight = route_internal_data->weight;
+        route.edges.clear();
         for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
             edge_id;
             edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]->prev_edge)
         {
-            edges.push_back(*edge_id);
+            route.edges.push_back(*edge_id);
         }
-        std::reverse(edges.begin(), edges.end());
-
-        return RouteInfo{ weight, std::move(edges) };
+        std::reverse(route.edges.begin(), route.edges.end());
+        return true;
     }
 
 }  // namespace graph
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "svg.h"
 
+#include <cstdio>
+
 namespace svg {
 
     using namespace std::literals;
@@ -10,7 +12,29 @@ namespace svg {
         // Делегируем вывод тега своим подклассам
         RenderObject(context);
 
-        context.out << std::endl;
+        context.out.put('\n');
+    }
+
+    void RenderPathAttrs(std::ostream& out, const PathStyle& style) {
+        if (style.fill_color) {
+            out << " fill=\""sv;
+            std::visit(PrintColor{ out }, *style.fill_color);
+            out << "\""sv;
+        }
+        if (style.stroke_color) {
+            out << " stroke=\""sv;
+            std::visit(PrintColor{ out }, *style.stroke_color);
+            out << "\""sv;
+        }
+        if (style.stroke_width) {
+            out << " stroke-width=\""sv << *style.stroke_width << "\""sv;
+        }
+        if (style.line_cap) {
+            out << " stroke-linecap=\""sv << *style.line_cap << "\""sv;
+        }
+        if (style.line_join) {
+            out << " stroke-linejoin=\""sv << *style.line_join << "\""sv;
+        }
     }
 
     // ---------- Circle ------------------
@@ -113,8 +137,8 @@ namespace svg {
     }
 
     void Document::Render(std::ostream& out) const {
-        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"sv << std::endl;
-        out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">"sv << std::endl;
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv;
+        out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
 
         RenderContext ctx(out, 2, 2);
         for (const auto& obj : objects_) {
@@ -124,4 +148,160 @@ namespace svg {
         out << "</svg>"sv;
     }
 
+    // ---------- StreamWriter ------------------
+
+    void StreamWriter::BeginDocument() {
+        out_ << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv;
+        out_ << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
+    }
+
+    void StreamWriter::BeginDocument(Point view_box_origin, double view_box_width, double view_box_height) {
+        out_ << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv;
+        out_ << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" viewBox=\""sv
+            << view_box_origin.x << ' ' << view_box_origin.y << ' ' << view_box_width << ' ' << view_box_height << "\">\n"sv;
+    }
+
+    void StreamWriter::EndDocument() {
+        out_ << "</svg>"sv;
+    }
+
+    void StreamWriter::BeginStyleSheet() {
+        out_ << "  <style>\n"sv;
+    }
+
+    void StreamWriter::WriteStyleRule(const PathStyle& style) {
+        out_ << "    ."sv << style.class_name << '{';
+        WriteCssProperties(style);
+        out_ << "}\n"sv;
+    }
+
+    void StreamWriter::WriteStyleRule(const TextStyle& style) {
+        out_ << "    ."sv << style.path.class_name << '{';
+        WriteCssProperties(style.path);
+        out_ << "font-size:"sv << style.font_size << "px"sv;
+        if (!style.font_family.empty()) {
+            out_ << ";font-family:"sv << style.font_family;
+        }
+        if (!style.font_weight.empty()) {
+            out_ << ";font-weight:"sv << style.font_weight;
+        }
+        out_ << "}\n"sv;
+    }
+
+    void StreamWriter::EndStyleSheet() {
+        out_ << "  </style>\n"sv;
+    }
+
+    void StreamWriter::WriteCssProperties(const PathStyle& style) {
+        if (style.fill_color) {
+            out_ << "fill:"sv;
+            std::visit(PrintColor{ out_ }, *style.fill_color);
+            out_ << ';';
+        }
+        if (style.stroke_color) {
+            out_ << "stroke:"sv;
+            std::visit(PrintColor{ out_ }, *style.stroke_color);
+            out_ << ';';
+        }
+        if (style.stroke_width) {
+            out_ << "stroke-width:"sv << *style.stroke_width << ';';
+        }
+        if (style.line_cap) {
+            out_ << "stroke-linecap:"sv << *style.line_cap << ';';
+        }
+        if (style.line_join) {
+            out_ << "stroke-linejoin:"sv << *style.line_join << ';';
+        }
+    }
+
+    void StreamWriter::WriteNumber(double value) {
+        if (!options_.precision) {
+            out_ << value;
+            return;
+        }
+
+        // Фиксированная точность без незначащих нулей в конце: 12.50 -> 12.5, 3.00 -> 3
+        char buffer[64];
+        int length = std::snprintf(buffer, sizeof(buffer), "%.*f", *options_.precision, value);
+        if (length <= 0 || length >= static_cast<int>(sizeof(buffer))) {
+            out_ << value;
+            return;
+        }
+        if (std::string_view(buffer, length).find('.') != std::string_view::npos) {
+            while (buffer[length - 1] == '0') {
+                --length;
+            }
+            if (buffer[length - 1] == '.') {
+                --length;
+            }
+        }
+        std::string_view number(buffer, length);
+        if (number == "-0"sv) {
+            number = "0"sv;
+        }
+        out_ << number;
+    }
+
+    void StreamWriter::WritePathStyle(const PathStyle& style) {
+        if (options_.use_classes && !style.class_name.empty()) {
+            out_ << " class=\""sv << style.class_name << '"';
+        }
+        else {
+            RenderPathAttrs(out_, style);
+        }
+    }
+
+    void StreamWriter::WriteCircle(Point center, double radius, const PathStyle& style) {
+        out_ << "  <circle cx=\""sv;
+        WriteNumber(center.x);
+        out_ << "\" cy=\""sv;
+        WriteNumber(center.y);
+        out_ << "\" r=\""sv << radius << "\""sv;
+        WritePathStyle(style);
+        out_ << "/>\n"sv;
+    }
+
+    void StreamWriter::BeginPolyline() {
+        out_ << "  <polyline points=\""sv;
+        first_point_ = true;
+    }
+
+    void StreamWriter::AddPolylinePoint(Point point) {
+        if (!first_point_) {
+            out_.put(' ');
+        }
+        first_point_ = false;
+        WriteNumber(point.x);
+        out_.put(',');
+        WriteNumber(point.y);
+    }
+
+    void StreamWriter::EndPolyline(const PathStyle& style) {
+        out_.put('"');
+        WritePathStyle(style);
+        out_ << "/>\n"sv;
+    }
+
+    void StreamWriter::WriteText(Point pos, std::string_view data, const TextStyle& style) {
+        const bool use_class = options_.use_classes && !style.path.class_name.empty();
+
+        out_ << "  <text"sv;
+        WritePathStyle(style.path);
+        out_ << " x=\""sv;
+        WriteNumber(pos.x);
+        out_ << "\" y=\""sv;
+        WriteNumber(pos.y);
+        out_ << "\" dx=\""sv << style.offset.x << "\" dy=\""sv << style.offset.y << '"';
+        if (!use_class) {
+            out_ << " font-size=\""sv << style.font_size << "\""sv;
+            if (!style.font_family.empty()) {
+                out_ << " font-family=\""sv << style.font_family << "\""sv;
+            }
+            if (!style.font_weight.empty()) {
+                out_ << " font-weight=\""sv << style.font_weight << "\""sv;
+            }
+        }
+        out_ << ">"sv << data << "</text>\n"sv;
+    }
+
 }
\ No newline at end of file
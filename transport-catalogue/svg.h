@@ -12,6 +12,7 @@
 #include <vector>
 #include <cmath>
 #include <optional>
+#include <string_view>
 #include <variant>
 
 namespace svg {
@@ -45,6 +46,14 @@ namespace svg {
         double opacity;
     };
 
+    inline bool operator==(const Rgb& lhs, const Rgb& rhs) {
+        return lhs.red == rhs.red && lhs.green == rhs.green && lhs.blue == rhs.blue;
+    }
+
+    inline bool operator==(const Rgba& lhs, const Rgba& rhs) {
+        return lhs.red == rhs.red && lhs.green == rhs.green && lhs.blue == rhs.blue && lhs.opacity == rhs.opacity;
+    }
+
     using Color = std::variant<std::monostate, std::string, svg::Rgb, svg::Rgba>;
 
     inline const Color NoneColor{ std::monostate{} };
@@ -128,6 +137,35 @@ namespace svg {
         double y = 0;
     };
 
+    /*
+     * Общие для всех путей атрибуты fill и stroke.
+     * Незаданные атрибуты не выводятся
+     */
+    struct PathStyle {
+        std::optional<Color> fill_color;
+        std::optional<Color> stroke_color;
+        std::optional<double> stroke_width;
+        std::optional<StrokeLineCap> line_cap;
+        std::optional<StrokeLineJoin> line_join;
+
+        // Имя CSS-класса, под которым стиль выводится в таблицу стилей документа (см. StreamWriter)
+        std::string class_name;
+    };
+
+    // Выводит в поток атрибуты fill и stroke, заданные в style
+    void RenderPathAttrs(std::ostream& out, const PathStyle& style);
+
+    /*
+     * Атрибуты текста, общие для многих элементов <text>: стиль пути, смещение и шрифт
+     */
+    struct TextStyle {
+        PathStyle path;
+        Point offset;
+        uint32_t font_size = 1;
+        std::string font_family;
+        std::string font_weight;
+    };
+
     /*
      * Вспомогательная структура, хранящая контекст для вывода SVG-документа с отступами.
      * Хранит ссылку на поток вывода, текущее значение и шаг отступа при выводе элемента
@@ -177,27 +215,27 @@ namespace svg {
     class PathProps {
     public:
         Owner& SetFillColor(const Color& color) {
-            fill_color_ = std::move(color);
+            style_.fill_color = color;
             return AsOwner();
         }
 
         Owner& SetStrokeColor(const Color& color) {
-            stroke_color_ = std::move(color);
+            style_.stroke_color = color;
             return AsOwner();
         }
 
         Owner& SetStrokeWidth(double width) {
-            width_ = std::move(width);
+            style_.stroke_width = width;
             return AsOwner();
         }
 
         Owner& SetStrokeLineCap(StrokeLineCap line_cap) {
-            line_cap_ = std::move(line_cap);
+            style_.line_cap = line_cap;
             return AsOwner();
         }
 
         Owner& SetStrokeLineJoin(StrokeLineJoin line_join) {
-            line_join_ = std::move(line_join);
+            style_.line_join = line_join;
             return AsOwner();
         }
 
@@ -206,27 +244,7 @@ namespace svg {
 
         // Метод RenderAttrs выводит в поток общие для всех путей атрибуты fill и stroke
         void RenderAttrs(std::ostream& out) const {
-            using namespace std::literals;
-
-            if (fill_color_) {
-                out << " fill=\""sv;
-                std::visit(PrintColor{ out }, *fill_color_);
-                out << "\""sv;
-            }
-            if (stroke_color_) {
-                out << " stroke=\""sv;
-                std::visit(PrintColor{ out }, *stroke_color_);
-                out << "\""sv;
-            }
-            if (width_) {
-                out << " stroke-width=\""sv << *width_ << "\""sv;
-            }
-            if (line_cap_) {
-                out << " stroke-linecap=\""sv << *line_cap_ << "\""sv;
-            }
-            if (line_join_) {
-                out << " stroke-linejoin=\""sv << *line_join_ << "\""sv;
-            }
+            RenderPathAttrs(out, style_);
         }
 
     private:
@@ -236,11 +254,7 @@ namespace svg {
             return static_cast<Owner&>(*this);
         }
 
-        std::optional<Color> fill_color_;
-        std::optional<Color> stroke_color_;
-        std::optional<double> width_;
-        std::optional<StrokeLineCap> line_cap_;
-        std::optional<StrokeLineJoin> line_join_;
+        PathStyle style_;
     };
 
     /*
@@ -343,6 +357,64 @@ namespace svg {
         std::vector<std::unique_ptr<Object>> objects_;
     };
 
+    /*
+     * Потоковая запись SVG-документа: каждый элемент сразу выводится в поток,
+     * без промежуточных объектов, виртуальных вызовов и сброса потока после каждой строки.
+     * Атрибуты берутся из заранее подготовленных стилей, общих для многих элементов.
+     * Для той же последовательности элементов вывод совпадает с Document::Render
+     */
+    class StreamWriter {
+    public:
+        struct Options {
+            // Число знаков после запятой для координат; без значения числа выводятся как есть
+            std::optional<int> precision;
+            // Стили, у которых задано имя класса, выводятся один раз в таблицу стилей,
+            // а элементы ссылаются на них атрибутом class вместо повторения атрибутов
+            bool use_classes = false;
+        };
+
+        explicit StreamWriter(std::ostream& out)
+            : StreamWriter(out, Options{}) {
+        }
+
+        StreamWriter(std::ostream& out, Options options)
+            : out_(out)
+            , options_(options) {
+        }
+
+        // Выводит заголовок документа и открывающий тег <svg>
+        void BeginDocument();
+        // То же, но с атрибутом viewBox: видимой остаётся только указанная область изображения
+        void BeginDocument(Point view_box_origin, double view_box_width, double view_box_height);
+        // Выводит закрывающий тег </svg>
+        void EndDocument();
+
+        // Таблица стилей выводится сразу после BeginDocument: BeginStyleSheet, WriteStyleRule..., EndStyleSheet.
+        // Имеет смысл только в режиме use_classes
+        void BeginStyleSheet();
+        void WriteStyleRule(const PathStyle& style);
+        void WriteStyleRule(const TextStyle& style);
+        void EndStyleSheet();
+
+        void WriteCircle(Point center, double radius, const PathStyle& style);
+
+        // Ломаная выводится по мере добавления вершин: BeginPolyline, AddPolylinePoint..., EndPolyline
+        void BeginPolyline();
+        void AddPolylinePoint(Point point);
+        void EndPolyline(const PathStyle& style);
+
+        void WriteText(Point pos, std::string_view data, const TextStyle& style);
+
+    private:
+        void WriteNumber(double value);
+        void WritePathStyle(const PathStyle& style);
+        void WriteCssProperties(const PathStyle& style);
+
+        std::ostream& out_;
+        const Options options_;
+        bool first_point_ = true;
+    };
+
     class Drawable {
     public:
         virtual ~Drawable() = default;
@@ -4,9 +4,10 @@
 using namespace transport_catalogue;
 
 void TransportCatalogue::AddStopStation(const std::string& id, const geo::Coordinates coordinates) {
+	++version_;
 	const StopStation* ptr_stop_station = GetStopStation(id);
 	if (!ptr_stop_station) {
-		stop_stations_.push_back({ id, coordinates });
+		stop_stations_.push_back({ id, coordinates, stop_stations_.size() });
 		hash_table_stop_stations_[stop_stations_.back().name] = &stop_stations_.back();
 	}
 	else {
@@ -15,7 +16,8 @@ void TransportCatalogue::AddStopStation(const std::string& id, const geo::Coordi
 }
 
 void TransportCatalogue::AddBus(const std::string& id, const std::vector<std::string_view>& route, bool is_roundtrip) {
-	bus_routes_.push_back({ id, {}, is_roundtrip});
+	++version_;
+	bus_routes_.push_back({ id, {}, is_roundtrip, bus_routes_.size() });
 	Bus& current_bus = bus_routes_.back();
 
 	for (std::string_view stop : route) {
@@ -110,6 +112,7 @@ void TransportCatalogue::SetDistanceBetweenStopsStations(std::string_view begin_
 	}
 
 	hash_table_distance_between_stops[{ptr_begin_stop, ptr_end_stop}] = distance;
+	++version_;
 }
 
 std::optional<int> TransportCatalogue::GetDistanceBetweenStopsStations(const StopStation* begin_stop_station, const StopStation* end_stop_station) const {
@@ -131,4 +134,34 @@ const std::deque<Bus>& TransportCatalogue::GetAllRoute() const {
 
 const std::deque<StopStation>& TransportCatalogue::GetAllStops() const {
 	return stop_stations_;
+}
+
+size_t TransportCatalogue::GetVersion() const {
+	return version_;
+}
+memory_stats::Report TransportCatalogue::MemoryStats() const {
+	memory_stats::Report report;
+
+	size_t stop_stations = memory_stats::HeapBytes(stop_stations_);
+	for (const StopStation& stop : stop_stations_) {
+		stop_stations += memory_stats::HeapBytes(stop.name);
+	}
+	report["stop_stations"] = stop_stations;
+	report["stop_index"] = memory_stats::HeapBytes(hash_table_stop_stations_);
+
+	size_t buses = memory_stats::HeapBytes(bus_routes_);
+	for (const Bus& bus : bus_routes_) {
+		buses += memory_stats::HeapBytes(bus.name) + memory_stats::HeapBytes(bus.route);
+	}
+	report["buses"] = buses;
+	report["bus_index"] = memory_stats::HeapBytes(hash_table_bus_routes_);
+
+	size_t routes_in_stop = memory_stats::HeapBytes(hash_table_routes_in_stop_);
+	for (const auto& [stop, bus_names] : hash_table_routes_in_stop_) {
+		routes_in_stop += memory_stats::HeapBytes(bus_names);
+	}
+	report["routes_in_stop"] = routes_in_stop;
+	report["distances"] = memory_stats::HeapBytes(hash_table_distance_between_stops);
+
+	return report;
 }
\ No newline at end of file
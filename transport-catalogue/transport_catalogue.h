@@ -1,5 +1,6 @@
 #pragma once
 #include "domain.h"
+#include "memory_stats.h"
 #include <deque>
 #include <optional>
 #include <set>
@@ -29,6 +30,12 @@ namespace transport_catalogue {
 		const std::deque<Bus>& GetAllRoute() const;
 		const std::deque<StopStation>& GetAllStops() const;
 
+		// Номер версии данных, увеличивается при каждом изменении справочника
+		size_t GetVersion() const;
+
+		// Оценка памяти внутренних контейнеров справочника, включая строки и маршруты внутри них
+		memory_stats::Report MemoryStats() const;
+
 	private:
 		struct StopPairHash {
 			size_t operator()(const std::pair<const StopStation*, const StopStation*>& stop_pair) const {
@@ -49,5 +56,7 @@ namespace transport_catalogue {
 		std::unordered_map<const StopStation*, std::set<std::string_view>> hash_table_routes_in_stop_;
 
 		std::unordered_map<std::pair<const StopStation*, const StopStation*>, int, StopPairHash> hash_table_distance_between_stops;
+
+		size_t version_ = 0;
 	};
 }
\ No newline at end of file
@@ -2,156 +2,494 @@
 
 #include "transport_catalogue.h"
 #include "graph.h"
+#include "lru_cache.h"
+#include "memory_stats.h"
 #include "router.h"
-
+#include "dijkstra_router.h"
+#include "partition_router.h"
+#include "hub_label_router.h"
+#include "parallel.h"
+#include "profile.h"
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <cmath>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include <string>
+#include <string_view>
 
 namespace graph {
 
+    // Способ поиска маршрутов
+    enum class RouterEngine {
+        AUTO,        // ALL_PAIRS, если его матрица укладывается в memory_budget_mb, иначе DIJKSTRA
+        ALL_PAIRS,   // предрасчёт всех пар вершин (Router): V^2 памяти, быстрые запросы
+        DIJKSTRA,    // поиск на каждый запрос (DijkstraRouter): O(V) памяти на поток
+        PARTITION,   // разбиение на ячейки (PartitionRouter): дешёвый пересчёт после изменения весов
+        HUB_LABELS,  // метки хабов (HubLabelRouter): запрос без поиска по графу, метки можно хранить в файле; веса менять нельзя
+    };
+
+    inline std::string_view GetRouterEngineName(RouterEngine engine) {
+        switch (engine) {
+        case RouterEngine::ALL_PAIRS:
+            return "all_pairs";
+        case RouterEngine::DIJKSTRA:
+            return "dijkstra";
+        case RouterEngine::PARTITION:
+            return "partition";
+        case RouterEngine::HUB_LABELS:
+            return "hub_labels";
+        default:
+            return "auto";
+        }
+    }
+
     struct RouteSetting {
         int bus_wait_time = 0;
         int bus_velocity = 0;
+        // Оставлять из параллельных рёбер поездок (с одинаковыми началом и концом) только самое быстрое
+        bool prune_parallel_edges = false;
+        // Сколько последних найденных маршрутов хранить в кеше; 0 — без кеша
+        size_t route_cache_size = 1024;
+        RouterEngine engine = RouterEngine::AUTO;
+        // Ограничение памяти на данные поиска при engine = AUTO
+        size_t memory_budget_mb = 1024;
+        // Наибольшее число вершин в ячейке при engine = PARTITION
+        size_t partition_cell_size = 64;
+        // Файл меток при engine = HUB_LABELS: загружается, если построен для того же графа, иначе записывается заново;
+        // пустая строка — метки строятся при каждом запуске
+        std::string hub_labels_file;
     };
 
-    struct BusEdgeData {
-        std::string bus_name;
-        int span_count = 0;
+    /*
+     * Переопределение скорости автобусов в км/ч, например из-за пробок или ремонта дороги.
+     * Если заданы from_stop и to_stop — для перегона from_stop -> to_stop у всех автобусов,
+     * иначе — для всего маршрута автобуса bus. Переопределение перегона важнее переопределения автобуса.
+     * velocity = 0 снимает переопределение
+     */
+    struct VelocityOverride {
+        std::string bus;
         std::string from_stop;
         std::string to_stop;
+        double velocity = 0;
+    };
+
+    // Сведения о ребре поездки на автобусе. Имена не хранятся: bus_id — номер автобуса в справочнике (Bus::id)
+    struct BusEdgeInfo {
+        uint32_t bus_id = 0;
+        uint16_t span_count = 0;
     };
 
     template <typename Weight>
     class TransportGraph {
     private:
         DirectedWeightedGraph<Weight> graph_;
+        const transport_catalogue::TransportCatalogue& catalogue_;
         int bus_velocity_;
         int bus_wait_time_;
+        bool prune_parallel_edges_;
+
+        // Рёбра ожидания добавляются первыми: ребро с номером i < wait_edge_count_ — ожидание на i-й остановке
+        // из GetAllStops(). Сведения о ребре поездки с номером id лежат в bus_edges_[id - wait_edge_count_]
+        size_t wait_edge_count_ = 0;
+        std::vector<BusEdgeInfo> bus_edges_;
+        // Рёбра автобуса с номером i занимают номера [bus_first_edge_[i], bus_first_edge_[i + 1])
+        std::vector<EdgeId> bus_first_edge_;
+
+        // Переопределения скорости: по номеру автобуса и по перегону (см. GetSegmentKey)
+        std::unordered_map<size_t, double> bus_velocities_;
+        std::unordered_map<size_t, double> segment_velocities_;
+
+        // Время в пути по нескольким перегонам. Перегоны со скоростью по умолчанию копят расстояние,
+        // время остальных сразу считается по их скорости
+        struct TravelTime {
+            double distance = 0;
+            double override_minutes = 0;
+        };
 
-        std::unordered_map<std::string, size_t> stop_to_wait_vertex_;
-        std::unordered_map<std::string, size_t> stop_to_bus_vertex_;
-        std::unordered_map<size_t, std::string> vertex_to_stop_;
-
-        std::unordered_map<size_t, BusEdgeData> bus_edges_;
+        // Рёбра поездок одного автобуса в порядке добавления и сведения о них
+        struct BusEdgesBuffer {
+            std::vector<Edge<Weight>> edges;
+            std::vector<BusEdgeInfo> infos;
+        };
 
     public:
-        TransportGraph(const transport_catalogue::TransportCatalogue& catalogue, const RouteSetting& rs)
-            : bus_velocity_(rs.bus_velocity), bus_wait_time_(rs.bus_wait_time) {
-            BuildGraph(catalogue);
+        // При thread_count > 1 рёбра поездок разных автобусов строятся параллельно; номера рёбер от этого не зависят
+        TransportGraph(const transport_catalogue::TransportCatalogue& catalogue, const RouteSetting& rs,
+            size_t thread_count = 1)
+            : catalogue_(catalogue), bus_velocity_(rs.bus_velocity), bus_wait_time_(rs.bus_wait_time)
+            , prune_parallel_edges_(rs.prune_parallel_edges) {
+            BuildGraph(thread_count);
         }
 
         const DirectedWeightedGraph<Weight>& GetGraph() const { return graph_; }
-        const std::unordered_map<size_t, BusEdgeData>& GetBusEdges() const { return bus_edges_; }
 
-        size_t GetWaitVertex(const std::string& stop_name) const {
-            return stop_to_wait_vertex_.at(stop_name);
+        const transport_catalogue::TransportCatalogue& GetCatalogue() const { return catalogue_; }
+
+        bool IsWaitEdge(EdgeId edge_id) const {
+            return edge_id < wait_edge_count_;
+        }
+
+        // Номер остановки ребра ожидания (StopStation::id)
+        size_t GetWaitEdgeStop(EdgeId edge_id) const {
+            return edge_id;
+        }
+
+        const BusEdgeInfo& GetBusEdge(EdgeId edge_id) const {
+            return bus_edges_[edge_id - wait_edge_count_];
+        }
+
+        // Оценка памяти графа и таблицы рёбер поездок
+        memory_stats::Report MemoryStats() const {
+            memory_stats::Report report = graph_.MemoryStats();
+            report["bus_edges"] = memory_stats::HeapBytes(bus_edges_);
+            report["bus_first_edge"] = memory_stats::HeapBytes(bus_first_edge_);
+            report["velocity_overrides"] = memory_stats::HeapBytes(bus_velocities_) + memory_stats::HeapBytes(segment_velocities_);
+            return report;
+        }
+
+        /*
+         * Запоминает переопределения скорости и пересчитывает веса рёбер затронутых автобусов на месте.
+         * Возвращает номера рёбер, вес которых изменился. Если хотя бы одно переопределение некорректно
+         * (неизвестные автобус или остановка, отрицательная скорость), выбрасывает std::invalid_argument
+         * и ничего не меняет. С prune_parallel_edges не работает (std::logic_error): отброшенные при построении
+         * рёбра после изменения скоростей могли бы стать лучшими
+         */
+        std::vector<EdgeId> ApplyVelocityOverrides(const std::vector<VelocityOverride>& overrides) {
+            if (prune_parallel_edges_) {
+                throw std::logic_error("Velocity overrides are not supported together with prune_parallel_edges");
+            }
+
+            const auto& all_buses = catalogue_.GetAllRoute();
+            std::vector<bool> affected_buses(all_buses.size(), false);
+            std::vector<std::pair<std::unordered_map<size_t, double>*, size_t>> targets;
+            targets.reserve(overrides.size());
+            for (const VelocityOverride& velocity_override : overrides) {
+                if (!(velocity_override.velocity >= 0.0) || !std::isfinite(velocity_override.velocity)) {
+                    throw std::invalid_argument("Velocity must be a non-negative number");
+                }
+                if (!velocity_override.from_stop.empty() || !velocity_override.to_stop.empty()) {
+                    const auto* from_stop = catalogue_.GetStopStation(velocity_override.from_stop);
+                    const auto* to_stop = catalogue_.GetStopStation(velocity_override.to_stop);
+                    if (!from_stop || !to_stop) {
+                        throw std::invalid_argument("Unknown stop in velocity override");
+                    }
+                    targets.emplace_back(&segment_velocities_, GetSegmentKey(*from_stop, *to_stop));
+                    for (std::string_view bus_name : catalogue_.GetStopStationInfo(from_stop->name)) {
+                        affected_buses[catalogue_.GetBus(bus_name)->id] = true;
+                    }
+                }
+                else {
+                    const auto* bus = catalogue_.GetBus(velocity_override.bus);
+                    if (!bus) {
+                        throw std::invalid_argument("Unknown bus in velocity override");
+                    }
+                    targets.emplace_back(&bus_velocities_, bus->id);
+                    affected_buses[bus->id] = true;
+                }
+            }
+
+            for (size_t i = 0; i < overrides.size(); ++i) {
+                auto& [velocities, key] = targets[i];
+                if (overrides[i].velocity == 0.0) {
+                    velocities->erase(key);
+                }
+                else {
+                    (*velocities)[key] = overrides[i].velocity;
+                }
+            }
+
+            std::vector<EdgeId> changed_edges;
+            UpdateBusEdgeWeights(affected_buses, changed_edges);
+            return changed_edges;
+        }
+
+        /*
+         * Меняет время ожидания и скорость по умолчанию (как в routing_settings) и пересчитывает веса рёбер
+         * на месте, сохраняя переопределения скорости. Возвращает номера рёбер, вес которых изменился.
+         * Значения должны быть положительными (иначе std::invalid_argument). Смена скорости
+         * с prune_parallel_edges не поддерживается (std::logic_error): рёбра строились для прежней скорости
+         */
+        std::vector<EdgeId> SetRoutingWeights(int bus_wait_time, int bus_velocity) {
+            if (bus_wait_time <= 0 || bus_velocity <= 0) {
+                throw std::invalid_argument("Bus wait time and velocity must be positive");
+            }
+            if (prune_parallel_edges_ && bus_velocity != bus_velocity_) {
+                throw std::logic_error("Changing bus velocity is not supported together with prune_parallel_edges");
+            }
+
+            std::vector<EdgeId> changed_edges;
+            if (bus_wait_time != bus_wait_time_) {
+                bus_wait_time_ = bus_wait_time;
+                for (EdgeId edge_id = 0; edge_id < wait_edge_count_; ++edge_id) {
+                    graph_.SetEdgeWeight(edge_id, static_cast<Weight>(bus_wait_time_));
+                    changed_edges.push_back(edge_id);
+                }
+            }
+            if (bus_velocity != bus_velocity_) {
+                bus_velocity_ = bus_velocity;
+                UpdateBusEdgeWeights(std::vector<bool>(catalogue_.GetAllRoute().size(), true), changed_edges);
+            }
+            return changed_edges;
+        }
+
+        int GetBusWaitTime() const {
+            return bus_wait_time_;
         }
 
-        const std::string& GetStopName(size_t vertex_id) const {
-            return vertex_to_stop_.at(vertex_id);
+        int GetBusVelocity() const {
+            return bus_velocity_;
+        }
+
+        // У остановки с номером i (StopStation::id) две вершины: ожидание 2i и посадка в автобус 2i + 1
+        static VertexId GetWaitVertex(const transport_catalogue::StopStation& stop) {
+            return stop.id * 2;
+        }
+
+        static VertexId GetBusVertex(const transport_catalogue::StopStation& stop) {
+            return stop.id * 2 + 1;
         }
 
     private:
-        void BuildGraph(const transport_catalogue::TransportCatalogue& catalogue) {
-            const auto& all_stops = catalogue.GetAllStops();
+        void BuildGraph(size_t thread_count) {
+            profile::ScopedPhase phase("build_graph", profile::AllocationTag::GRAPH);
+            const auto& all_stops = catalogue_.GetAllStops();
+            const auto& all_buses = catalogue_.GetAllRoute();
+            if (all_buses.size() > std::numeric_limits<uint32_t>::max()) {
+                throw std::length_error("Too many buses for the routing graph");
+            }
             graph_ = DirectedWeightedGraph<Weight>(all_stops.size() * 2);
 
-            size_t vertex_id = 0;
             for (const auto& stop : all_stops) {
-                stop_to_wait_vertex_[stop.name] = vertex_id;
-                stop_to_bus_vertex_[stop.name] = vertex_id + 1;
-
-                vertex_to_stop_[vertex_id] = stop.name;
-                vertex_to_stop_[vertex_id + 1] = stop.name;
-
                 graph_.AddEdge({
-                    vertex_id,
-                    vertex_id + 1,
+                    GetWaitVertex(stop),
+                    GetBusVertex(stop),
                     static_cast<Weight>(bus_wait_time_)
                     });
+            }
+            wait_edge_count_ = all_stops.size();
+
+            // Каждый автобус заполняет свой буфер, затем буферы сливаются в граф по порядку автобусов,
+            // поэтому номера рёбер и порядок списков смежности те же, что при последовательном построении
+            std::vector<BusEdgesBuffer> buffers(all_buses.size());
+            parallel::ForEachIndex(all_buses.size(), thread_count, [&](size_t index) {
+                CollectBusEdges(all_buses[index], buffers[index]);
+            });
+
+            if (prune_parallel_edges_) {
+                PruneParallelEdges(buffers);
+            }
+
+            size_t bus_edge_count = 0;
+            for (const BusEdgesBuffer& buffer : buffers) {
+                bus_edge_count += buffer.edges.size();
+            }
+            graph_.ReserveEdges(wait_edge_count_ + bus_edge_count);
+            bus_edges_.reserve(bus_edge_count);
+
+            bus_first_edge_.reserve(buffers.size() + 1);
+            for (BusEdgesBuffer& buffer : buffers) {
+                bus_first_edge_.push_back(graph_.GetEdgeCount());
+                for (const Edge<Weight>& edge : buffer.edges) {
+                    graph_.AddEdge(edge);
+                }
+                bus_edges_.insert(bus_edges_.end(), buffer.infos.begin(), buffer.infos.end());
+                buffer = {};
+            }
+            bus_first_edge_.push_back(graph_.GetEdgeCount());
+
+            profile::AddCounter("graph.vertices", graph_.GetVertexCount());
+            profile::AddCounter("graph.edges", graph_.GetEdgeCount());
+        }
+
+        /*
+         * Из рёбер поездок с одинаковыми началом и концом оставляет одно: с наименьшим весом,
+         * при равных весах — автобус с меньшим именем, затем с меньшим числом пролётов.
+         * Выбор не зависит от порядка автобусов в справочнике, оставшиеся рёбра сохраняют свой порядок
+         */
+        void PruneParallelEdges(std::vector<BusEdgesBuffer>& buffers) const {
+            const auto& all_buses = catalogue_.GetAllRoute();
+            auto is_better = [&all_buses](const Edge<Weight>& lhs_edge, const BusEdgeInfo& lhs_info,
+                const Edge<Weight>& rhs_edge, const BusEdgeInfo& rhs_info) {
+                if (lhs_edge.weight != rhs_edge.weight) {
+                    return lhs_edge.weight < rhs_edge.weight;
+                }
+                const std::string& lhs_name = all_buses[lhs_info.bus_id].name;
+                const std::string& rhs_name = all_buses[rhs_info.bus_id].name;
+                if (lhs_name != rhs_name) {
+                    return lhs_name < rhs_name;
+                }
+                return lhs_info.span_count < rhs_info.span_count;
+            };
 
-                vertex_id += 2;
+            // Лучшее ребро для пары вершин: номер буфера и номер ребра в нём
+            const size_t vertex_count = graph_.GetVertexCount();
+            std::unordered_map<size_t, std::pair<size_t, size_t>> best;
+            for (size_t buffer_index = 0; buffer_index < buffers.size(); ++buffer_index) {
+                const BusEdgesBuffer& buffer = buffers[buffer_index];
+                for (size_t edge_index = 0; edge_index < buffer.edges.size(); ++edge_index) {
+                    const Edge<Weight>& edge = buffer.edges[edge_index];
+                    auto [it, inserted] = best.emplace(edge.from * vertex_count + edge.to, std::pair{ buffer_index, edge_index });
+                    if (!inserted) {
+                        const auto [best_buffer, best_edge] = it->second;
+                        if (is_better(edge, buffer.infos[edge_index], buffers[best_buffer].edges[best_edge], buffers[best_buffer].infos[best_edge])) {
+                            it->second = { buffer_index, edge_index };
+                        }
+                    }
+                }
             }
 
-            for (const auto& bus : catalogue.GetAllRoute()) {
-                AddBusEdges(catalogue, bus);
+            size_t pruned = 0;
+            for (size_t buffer_index = 0; buffer_index < buffers.size(); ++buffer_index) {
+                BusEdgesBuffer& buffer = buffers[buffer_index];
+                size_t kept = 0;
+                for (size_t edge_index = 0; edge_index < buffer.edges.size(); ++edge_index) {
+                    const Edge<Weight>& edge = buffer.edges[edge_index];
+                    if (best.at(edge.from * vertex_count + edge.to) == std::pair{ buffer_index, edge_index }) {
+                        buffer.edges[kept] = buffer.edges[edge_index];
+                        buffer.infos[kept] = buffer.infos[edge_index];
+                        ++kept;
+                    }
+                }
+                pruned += buffer.edges.size() - kept;
+                buffer.edges.resize(kept);
+                buffer.infos.resize(kept);
             }
+
+            profile::AddCounter("graph.pruned_edges", pruned);
         }
 
-        void AddBusEdges(const transport_catalogue::TransportCatalogue& catalogue,
-            const transport_catalogue::Bus& bus) {
+        // Строит рёбра отмеченных автобусов заново в том же порядке, что и при построении графа, и обновляет изменившиеся веса
+        void UpdateBusEdgeWeights(const std::vector<bool>& affected_buses, std::vector<EdgeId>& changed_edges) {
+            const auto& all_buses = catalogue_.GetAllRoute();
+            BusEdgesBuffer buffer;
+            for (size_t bus_id = 0; bus_id < all_buses.size(); ++bus_id) {
+                if (!affected_buses[bus_id]) {
+                    continue;
+                }
+                buffer.edges.clear();
+                buffer.infos.clear();
+                CollectBusEdges(all_buses[bus_id], buffer);
+                const EdgeId first_edge = bus_first_edge_[bus_id];
+                for (size_t i = 0; i < buffer.edges.size(); ++i) {
+                    if (graph_.GetEdge(first_edge + i).weight != buffer.edges[i].weight) {
+                        graph_.SetEdgeWeight(first_edge + i, buffer.edges[i].weight);
+                        changed_edges.push_back(first_edge + i);
+                    }
+                }
+            }
+        }
+
+        // Только читает справочник, поэтому может вызываться из нескольких потоков одновременно
+        void CollectBusEdges(const transport_catalogue::Bus& bus, BusEdgesBuffer& buffer) const {
+            const auto& catalogue = catalogue_;
             const auto& stops = bus.route;
 
             if (bus.is_roundtrip) {
                 for (size_t i = 0; i < stops.size(); ++i) {
-                    double total_distance = 0;
+                    TravelTime travel;
                     for (size_t j = i + 1; j < stops.size(); ++j) {
                         auto dist = catalogue.GetDistanceBetweenStopsStations(stops[j - 1], stops[j]);
                         if (!dist) {
                             dist = catalogue.GetDistanceBetweenStopsStations(stops[j], stops[j - 1]);
                         }
                         if (dist) {
-                            total_distance += *dist;
-                            AddBusEdge(bus.name, stops[i]->name, stops[j]->name,
-                                j - i, total_distance);
+                            AddSegment(travel, bus, *stops[j - 1], *stops[j], *dist);
+                            AddBusEdge(buffer, bus.id, *stops[i], *stops[j],
+                                j - i, travel);
                         }
                     }
                 }
             }
             else {
                 for (size_t i = 0; i < stops.size(); ++i) {
-                    double total_distance = 0;
+                    TravelTime travel;
                     for (size_t j = i + 1; j < stops.size(); ++j) {
                         auto dist = catalogue.GetDistanceBetweenStopsStations(stops[j - 1], stops[j]);
                         if (!dist) {
                             dist = catalogue.GetDistanceBetweenStopsStations(stops[j], stops[j - 1]);
                         }
                         if (dist) {
-                            total_distance += *dist;
-                            AddBusEdge(bus.name, stops[i]->name, stops[j]->name,
-                                j - i, total_distance);
+                            AddSegment(travel, bus, *stops[j - 1], *stops[j], *dist);
+                            AddBusEdge(buffer, bus.id, *stops[i], *stops[j],
+                                j - i, travel);
                         }
                     }
                 }
 
                 for (size_t i = stops.size() - 1; i > 0; --i) {
-                    double total_distance = 0;
+                    TravelTime travel;
                     for (size_t j = i - 1; j != static_cast<size_t>(-1); --j) {
                         auto dist = catalogue.GetDistanceBetweenStopsStations(stops[j + 1], stops[j]);
                         if (!dist) {
                             dist = catalogue.GetDistanceBetweenStopsStations(stops[j], stops[j + 1]);
                         }
                         if (dist) {
-                            total_distance += *dist;
-                            AddBusEdge(bus.name, stops[i]->name, stops[j]->name,
-                                i - j, total_distance);
+                            AddSegment(travel, bus, *stops[j + 1], *stops[j], *dist);
+                            AddBusEdge(buffer, bus.id, *stops[i], *stops[j],
+                                i - j, travel);
                         }
                     }
                 }
             }
         }
 
-        void AddBusEdge(const std::string& bus_name, const std::string& from_stop,
-            const std::string& to_stop, int span_count, double total_distance) {
-            double time_minutes = (total_distance / 1000.0) / bus_velocity_ * 60.0;
+        size_t GetSegmentKey(const transport_catalogue::StopStation& from_stop, const transport_catalogue::StopStation& to_stop) const {
+            return from_stop.id * catalogue_.GetAllStops().size() + to_stop.id;
+        }
 
-            size_t from_vertex = stop_to_bus_vertex_.at(from_stop);
-            size_t to_vertex = stop_to_wait_vertex_.at(to_stop);
+        std::optional<double> FindVelocityOverride(const transport_catalogue::Bus& bus,
+            const transport_catalogue::StopStation& from_stop, const transport_catalogue::StopStation& to_stop) const {
+            if (!segment_velocities_.empty()) {
+                if (auto it = segment_velocities_.find(GetSegmentKey(from_stop, to_stop)); it != segment_velocities_.end()) {
+                    return it->second;
+                }
+            }
+            if (!bus_velocities_.empty()) {
+                if (auto it = bus_velocities_.find(bus.id); it != bus_velocities_.end()) {
+                    return it->second;
+                }
+            }
+            return std::nullopt;
+        }
 
-            size_t edge_id = graph_.AddEdge({
+        void AddSegment(TravelTime& travel, const transport_catalogue::Bus& bus, const transport_catalogue::StopStation& from_stop,
+            const transport_catalogue::StopStation& to_stop, int distance) const {
+            if (auto velocity = FindVelocityOverride(bus, from_stop, to_stop)) {
+                travel.override_minutes += (distance / 1000.0) / *velocity * 60.0;
+            }
+            else {
+                travel.distance += distance;
+            }
+        }
+
+        void AddBusEdge(BusEdgesBuffer& buffer, size_t bus_id, const transport_catalogue::StopStation& from_stop,
+            const transport_catalogue::StopStation& to_stop, size_t span_count, const TravelTime& travel) const {
+            if (span_count > std::numeric_limits<uint16_t>::max()) {
+                throw std::length_error("Bus route is too long for the routing graph");
+            }
+
+            double time_minutes = (travel.distance / 1000.0) / bus_velocity_ * 60.0 + travel.override_minutes;
+
+            VertexId from_vertex = GetBusVertex(from_stop);
+            VertexId to_vertex = GetWaitVertex(to_stop);
+
+            buffer.edges.push_back({
                 from_vertex,
                 to_vertex,
                 static_cast<Weight>(time_minutes)
                 });
 
-            bus_edges_[edge_id] = {
-                bus_name,
-                span_count,
-                from_stop,
-                to_stop
-            };
+            buffer.infos.push_back({ static_cast<uint32_t>(bus_id), static_cast<uint16_t>(span_count) });
         }
     };
 
@@ -159,20 +497,82 @@ namespace graph {
     class TransportRouter {
     private:
         TransportGraph<Weight> graph_;
-        Router<Weight> router_;
+        RouterEngine engine_;
+        std::unique_ptr<RouteEngine<Weight>> router_;
+        size_t thread_count_;
+        // Поиск маршрутов берёт разделяемую блокировку, изменение весов — исключительную
+        mutable std::shared_mutex update_mutex_;
 
     public:
         TransportRouter(const transport_catalogue::TransportCatalogue& catalogue,
-            const RouteSetting& rs)
-            : graph_(catalogue, rs)
-            , router_(graph_.GetGraph()) { 
+            const RouteSetting& rs, size_t thread_count = 1)
+            : graph_(catalogue, rs, thread_count)
+            , engine_(ChooseEngine(rs, graph_.GetGraph().GetVertexCount()))
+            , router_(MakeEngine(engine_, graph_.GetGraph(), rs, thread_count))
+            , thread_count_(thread_count)
+            , route_cache_(rs.route_cache_size) {
+        }
+
+        const TransportGraph<Weight>& GetTransportGraph() const {
+            return graph_;
+        }
+
+        const RouteEngine<Weight>& GetRouter() const {
+            return *router_;
+        }
+
+        struct MemoryReport {
+            memory_stats::Report graph;
+            memory_stats::Report router;
+        };
+
+        // Оценка памяти графа и данных поиска под разделяемой блокировкой: обновление весов перестраивает
+        // эти же вектора, поэтому читать их размеры без блокировки нельзя
+        MemoryReport MemoryStats() const {
+            std::shared_lock lock(update_mutex_);
+            return { graph_.MemoryStats(), router_->MemoryStats() };
+        }
+
+        /*
+         * Применяет переопределения скоростей (см. TransportGraph::ApplyVelocityOverrides): веса рёбер
+         * меняются на месте, данные поиска пересчитываются только там, где зависят от изменённых рёбер,
+         * кеш маршрутов очищается. Возвращает число изменённых рёбер.
+         * Можно вызывать одновременно с FindRoute: поиски дожидаются окончания обновления.
+         * Для способа поиска без изменения весов (HUB_LABELS) выбрасывает std::logic_error, ничего не меняя
+         */
+        size_t ApplyVelocityOverrides(const std::vector<VelocityOverride>& overrides) {
+            CheckWeightUpdatesSupported();
+            std::unique_lock lock(update_mutex_);
+            profile::ScopedPhase phase("velocity_overrides", profile::AllocationTag::ROUTER);
+            return UpdateEdgeWeights(graph_.ApplyVelocityOverrides(overrides));
+        }
+
+        /*
+         * Переключает профиль весов — время ожидания и скорость по умолчанию (см. TransportGraph::SetRoutingWeights)
+         * без перестройки графа и данных поиска: они пересчитываются так же, как после переопределения скоростей.
+         * Дешевле всего это для engine = PARTITION. Незаданное значение остаётся прежним.
+         * Возвращает число изменённых рёбер; для HUB_LABELS выбрасывает std::logic_error, как ApplyVelocityOverrides
+         */
+        size_t SetRoutingWeights(std::optional<int> bus_wait_time, std::optional<int> bus_velocity) {
+            CheckWeightUpdatesSupported();
+            std::unique_lock lock(update_mutex_);
+            profile::ScopedPhase phase("routing_weights", profile::AllocationTag::ROUTER);
+            return UpdateEdgeWeights(graph_.SetRoutingWeights(bus_wait_time.value_or(graph_.GetBusWaitTime()),
+                bus_velocity.value_or(graph_.GetBusVelocity())));
+        }
+
+        // Выбранный способ поиска (не AUTO)
+        RouterEngine GetEngine() const {
+            return engine_;
         }
 
+        // Элемент маршрута хранит номер остановки (WAIT) или автобуса (BUS) в справочнике
+        // и его имя — ссылку на строку внутри справочника, без копирования
         struct RouteItem {
             enum class Type { WAIT, BUS };
             Type type;
-            std::string stop_name;
-            std::string bus_name;
+            uint32_t id = 0;
+            std::string_view name;
             Weight time;
             int span_count = 0;
         };
@@ -182,57 +582,236 @@ namespace graph {
             std::vector<RouteItem> items;
         };
 
-        std::optional<RouteResult> FindRoute(const std::string& from, const std::string& to) const {
-            try {
-                size_t from_vertex = graph_.GetWaitVertex(from);
-                size_t to_vertex = graph_.GetWaitVertex(to);
+        // Запись кеша с found == false означает, что маршрута нет
+        struct CachedRoute {
+            bool found = false;
+            RouteResult result;
+        };
 
-                auto route_info = router_.BuildRoute(from_vertex, to_vertex);
-                if (!route_info) {
-                    return std::nullopt;
-                }
+        using RouteCache = cache::FixedLruCache<size_t, CachedRoute>;
 
-                return BuildRouteResult(*route_info);
+        // Память для поиска маршрута, переиспользуемая между запросами (например, своя у каждого потока)
+        struct RouteWorkspace {
+            RouteResult result;
+            RouteInfo<Weight> route_info;
+        };
+
+        /*
+         * Ищет маршрут и записывает его в workspace.result; возвращает false, если маршрута нет
+         * или одна из остановок неизвестна. Исключений для неизвестных остановок не выбрасывает.
+         * Имена остановок ищутся в справочнике один раз, дальше работа идёт только с номерами вершин.
+         * Когда вектора workspace и слотов кеша выросли до нужного размера, поиск не выделяет память:
+         * кеш выделяет слоты при создании (см. RouteSetting::route_cache_size) и копирует результат в них.
+         * Результаты, в том числе отсутствие маршрута, запоминаются в LRU-кеше по паре остановок;
+         * попадания и промахи считаются в счётчиках route_cache.hits и route_cache.misses
+         */
+        bool FindRoute(std::string_view from, std::string_view to, RouteWorkspace& workspace) const {
+            const auto& catalogue = graph_.GetCatalogue();
+            const transport_catalogue::StopStation* from_stop = catalogue.GetStopStation(from);
+            const transport_catalogue::StopStation* to_stop = catalogue.GetStopStation(to);
+            if (!from_stop || !to_stop) {
+                return false;
             }
-            catch (const std::exception&) {
+
+            std::shared_lock lock(update_mutex_);
+            const size_t key = from_stop->id * catalogue.GetAllStops().size() + to_stop->id;
+            bool found = false;
+            if (route_cache_.Read(key, [&](const CachedRoute& cached) {
+                    found = cached.found;
+                    if (found) {
+                        workspace.result = cached.result;
+                    }
+                })) {
+                profile::AddCounter("route_cache.hits", 1);
+                return found;
+            }
+            profile::AddCounter("route_cache.misses", 1);
+
+            found = router_->BuildRoute(TransportGraph<Weight>::GetWaitVertex(*from_stop),
+                TransportGraph<Weight>::GetWaitVertex(*to_stop), workspace.route_info);
+            if (found) {
+                BuildRouteResult(workspace.route_info, workspace.result);
+            }
+            route_cache_.Write(key, [&](CachedRoute& cached) {
+                cached.found = found;
+                if (found) {
+                    cached.result = workspace.result;
+                }
+            });
+            return found;
+        }
+
+        std::optional<RouteResult> FindRoute(std::string_view from, std::string_view to) const {
+            RouteWorkspace workspace;
+            if (!FindRoute(from, to, workspace)) {
                 return std::nullopt;
             }
+            return std::move(workspace.result);
+        }
+
+        typename RouteCache::Stats GetRouteCacheStats() const {
+            return route_cache_.GetStats();
         }
 
     private:
-        RouteResult BuildRouteResult(const typename Router<Weight>::RouteInfo& route_info) const {
-            RouteResult result;
+        /*
+         * При engine = AUTO матрица всех пар выбирается, если её оценка укладывается в бюджет памяти,
+         * иначе — поиск на каждый запрос. Выбор и оценка памяти попадают в счётчики router.engine.<имя>
+         * и router.estimated_bytes
+         */
+        static RouterEngine ChooseEngine(const RouteSetting& rs, size_t vertex_count) {
+            RouterEngine engine = rs.engine;
+            const size_t all_pairs_bytes = Router<Weight>::EstimateMemory(vertex_count);
+            if (engine == RouterEngine::AUTO) {
+                const size_t budget_bytes = rs.memory_budget_mb * 1024 * 1024;
+                engine = all_pairs_bytes <= budget_bytes ? RouterEngine::ALL_PAIRS : RouterEngine::DIJKSTRA;
+            }
+
+            size_t estimated_bytes = 0;
+            switch (engine) {
+            case RouterEngine::ALL_PAIRS:
+                estimated_bytes = all_pairs_bytes;
+                break;
+            case RouterEngine::PARTITION:
+                estimated_bytes = PartitionRouter<Weight>::EstimateMemory(vertex_count);
+                break;
+            case RouterEngine::HUB_LABELS:
+                estimated_bytes = HubLabelRouter<Weight>::EstimateMemory(vertex_count);
+                break;
+            default:
+                estimated_bytes = DijkstraRouter<Weight>::EstimateMemory(vertex_count);
+            }
+            profile::AddCounter(std::string("router.engine.") + std::string(GetRouterEngineName(engine)), 1);
+            profile::AddCounter("router.estimated_bytes", estimated_bytes);
+            return engine;
+        }
+
+        static std::unique_ptr<RouteEngine<Weight>> MakeEngine(RouterEngine engine, const DirectedWeightedGraph<Weight>& graph,
+            const RouteSetting& rs, size_t thread_count) {
+            switch (engine) {
+            case RouterEngine::DIJKSTRA:
+                return std::make_unique<DijkstraRouter<Weight>>(graph);
+            case RouterEngine::PARTITION:
+                return std::make_unique<PartitionRouter<Weight>>(graph, rs.partition_cell_size, thread_count);
+            case RouterEngine::HUB_LABELS:
+                return std::make_unique<HubLabelRouter<Weight>>(graph, rs.hub_labels_file);
+            default:
+                return std::make_unique<Router<Weight>>(graph);
+            }
+        }
+
+        void CheckWeightUpdatesSupported() const {
+            if (!router_->SupportsWeightUpdates()) {
+                throw std::logic_error("Engine \"" + std::string(GetRouterEngineName(engine_))
+                    + "\" does not support changing edge weights, use engine \"dijkstra\" or \"partition\"");
+            }
+        }
+
+        // Вызывается под исключительной блокировкой после изменения весов рёбер графа
+        size_t UpdateEdgeWeights(const std::vector<EdgeId>& changed_edges) {
+            if (!changed_edges.empty()) {
+                router_->UpdateEdgeWeights(changed_edges, thread_count_);
+                route_cache_.Clear();
+            }
+            profile::AddCounter("router.updated_edges", changed_edges.size());
+            return changed_edges.size();
+        }
+
+        void BuildRouteResult(const RouteInfo<Weight>& route_info, RouteResult& result) const {
             result.total_time = route_info.weight;
+            result.items.clear();
 
-            const auto& bus_edges = graph_.GetBusEdges();
+            const auto& catalogue = graph_.GetCatalogue();
             const auto& graph = graph_.GetGraph();
 
             for (size_t edge_id : route_info.edges) {
                 const auto& edge = graph.GetEdge(edge_id);
 
-                auto bus_edge_it = bus_edges.find(edge_id);
-                if (bus_edge_it != bus_edges.end()) {
+                if (graph_.IsWaitEdge(edge_id)) {
+                    const size_t stop_id = graph_.GetWaitEdgeStop(edge_id);
                     result.items.push_back({
-                        RouteItem::Type::BUS,
-                        "",
-                        bus_edge_it->second.bus_name,
+                        RouteItem::Type::WAIT,
+                        static_cast<uint32_t>(stop_id),
+                        catalogue.GetAllStops()[stop_id].name,
                         edge.weight,
-                        bus_edge_it->second.span_count
+                        0
                         });
                 }
                 else {
-                    const std::string& stop_name = graph_.GetStopName(edge.from);
+                    const BusEdgeInfo& bus_edge = graph_.GetBusEdge(edge_id);
                     result.items.push_back({
-                        RouteItem::Type::WAIT,
-                        stop_name,
-                        "", 
+                        RouteItem::Type::BUS,
+                        bus_edge.bus_id,
+                        catalogue.GetAllRoute()[bus_edge.bus_id].name,
                         edge.weight,
-                        0
+                        bus_edge.span_count
                         });
                 }
             }
+        }
 
-            return result;
+        mutable RouteCache route_cache_;
+    };
+    // Когда строить маршрутизатор (построение включает полный предрасчёт всех маршрутов)
+    enum class RouterBuildMode {
+        EAGER,       // сразу, в конструкторе
+        LAZY,        // при первом запросе маршрута
+        BACKGROUND,  // в фоновом потоке; запросы маршрутов ждут окончания построения
+    };
+
+    /*
+     * Обёртка над TransportRouter, откладывающая его построение.
+     * Пока маршрутизатор не нужен (запросы Stop, Bus, Map), предрасчёт не выполняется или идёт в фоне.
+     * Методы константные и потокобезопасные: построение выполняется ровно один раз
+     */
+    template <typename Weight>
+    class LazyTransportRouter {
+    public:
+        LazyTransportRouter(const transport_catalogue::TransportCatalogue& catalogue,
+            const RouteSetting& rs, RouterBuildMode mode = RouterBuildMode::LAZY, size_t thread_count = 1)
+            : router_(std::async(mode == RouterBuildMode::BACKGROUND ? std::launch::async : std::launch::deferred,
+                [&catalogue, rs, thread_count]() {
+                    return std::make_shared<TransportRouter<Weight>>(catalogue, rs, thread_count);
+                }).share())
+        {
+            if (mode == RouterBuildMode::EAGER) {
+                router_.wait();
+            }
+        }
+
+        // Возвращает маршрутизатор, при необходимости строя его или дожидаясь фонового построения
+        const TransportRouter<Weight>& Get() const {
+            return *router_.get();
+        }
+
+        auto FindRoute(std::string_view from, std::string_view to) const {
+            return Get().FindRoute(from, to);
+        }
+
+        bool FindRoute(std::string_view from, std::string_view to,
+            typename TransportRouter<Weight>::RouteWorkspace& workspace) const {
+            return Get().FindRoute(from, to, workspace);
+        }
+
+        // Применяет переопределения скоростей (см. TransportRouter::ApplyVelocityOverrides), при необходимости строя маршрутизатор
+        size_t ApplyVelocityOverrides(const std::vector<VelocityOverride>& overrides) {
+            return router_.get()->ApplyVelocityOverrides(overrides);
+        }
+
+        // Переключает профиль весов (см. TransportRouter::SetRoutingWeights), при необходимости строя маршрутизатор
+        size_t SetRoutingWeights(std::optional<int> bus_wait_time, std::optional<int> bus_velocity) {
+            return router_.get()->SetRoutingWeights(bus_wait_time, bus_velocity);
         }
+
+        // Возвращает маршрутизатор, только если он уже построен; построение не запускает и не ждёт
+        const TransportRouter<Weight>* GetIfReady() const {
+            if (router_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                return nullptr;
+            }
+            return router_.get().get();
+        }
+
+    private:
+        std::shared_future<std::shared_ptr<TransportRouter<Weight>>> router_;
     };
 }
\ No newline at end of file